@@ -0,0 +1,473 @@
+/*
+ *  ChkTeX, result cache.
+ *  Copyright (C) 1995-96 Jens T. Berger Thielemann
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Contact the author at:
+ *              Jens Berger
+ *              Spektrumvn. 4
+ *              N-0666 Oslo
+ *              Norway
+ *              E-mail: <jensthi@ifi.uio.no>
+ *
+ *
+ */
+
+/*
+ * With --cache=DIR, the results for each file are kept in DIR, under
+ * a digest of everything which may affect them: our version, the
+ * settings, the file's name and its contents. Files which haven't
+ * changed since the last run are then not checked again; we just
+ * write out what we found last time.
+ *
+ * The files it \input's are noted in the entry with digests of their
+ * contents, and the entry is only used if they are still the same.
+ * Entries are written to a temporary file which is then renamed, so
+ * several runs may share the directory.
+ *
+ * An entry looks like
+ *
+ *      ChkTeX cache 1\n
+ *      <retval> <errors> <warnings> <usersupp> <linesupp> <#inputs> <outlen> <errlen>\n
+ *
+ * followed by each \input file as
+ *
+ *      <digest> <namelen> <pathlen>\n<name><path>
+ *
+ * (with a digest of `-' and no path for files which weren't found),
+ * and finally the output and the program messages, as written.
+ */
+
+#include "ChkTeX.h"
+#include "FindErrs.h"
+#include "OpSys.h"
+#include "Utility.h"
+#include "Resource.h"
+#include "Cache.h"
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#  include <unistd.h>
+#endif
+#if defined(HAVE_FCHMOD) && defined(HAVE_SYS_STAT_H)
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  define USE_FCHMOD 1
+#endif
+
+#define CACHEMAGIC      "ChkTeX cache 1\n"
+
+/*
+ * Longest line in the header of an entry.
+ */
+#define HEADLINELEN     256
+
+struct Dep
+{
+    char *Name;                 /* As given to \input */
+    char *Path;                 /* Where we found it, or NULL */
+    struct Digest Hash;         /* Of its contents */
+};
+
+static struct Digest ConfigHash;
+
+#ifdef USE_FCHMOD
+/*
+ * The mode of new entries. mkstemp() makes them 0600, which would keep
+ * other users sharing the directory from reading them.
+ */
+static mode_t EntryMode;
+#endif
+
+static void HashNum(long Num)
+{
+    char Buf[32];
+
+    sprintf(Buf, "%ld", Num);
+    AddDigestStr(&ConfigHash, Buf);
+}
+
+static void HashList(const char *Name, const struct WordList *wl)
+{
+    unsigned long i;
+
+    AddDigestStr(&ConfigHash, Name);
+    HashNum((long) wl->Stack.Used);
+    FORWL(i, *wl)
+        AddDigestStr(&ConfigHash, wl->Stack.Data[i]);
+}
+
+/*
+ * Takes note of the settings; call once they're final.
+ */
+
+void SetupCache(void)
+{
+    unsigned long Cnt;
+
+#ifdef USE_FCHMOD
+    /* We can only read the umask by setting it; no threads yet */
+    EntryMode = umask(0);
+    umask(EntryMode);
+    EntryMode = 0666 & ~EntryMode;
+#endif
+
+    InitDigest(&ConfigHash);
+    AddDigestStr(&ConfigHash, PACKAGE_VERSION);
+
+#undef KEY
+#undef LCASE
+#undef LNEMPTY
+#undef LIST
+
+#define LNEMPTY    LIST
+#define LIST(a)    HashList(#a, &a);
+#define LCASE(a)   LIST(a); LIST(a ## Case);
+#define KEY(a,def) AddDigestStr(&ConfigHash, #a); AddDigestStr(&ConfigHash, a);
+
+    RESOURCE_INFO
+
+    for (Cnt = emMinFault + 1; Cnt < emMaxFault; Cnt++)
+    {
+        HashNum((long) LaTeXMsgs[Cnt].Type);
+        HashNum((long) LaTeXMsgs[Cnt].InUse);
+    }
+
+    AddDigestStr(&ConfigHash, OutputFormat);
+    AddDigestStr(&ConfigHash, Delimit);
+    AddDigestStr(&ConfigHash, PseudoInName);
+    AddDigestStr(&ConfigHash, ReverseOn);
+    AddDigestStr(&ConfigHash, ReverseOff);
+    HashNum((long) WipeVerb);
+    HashNum((long) InputFiles);
+    HashNum((long) HeadErrOut);
+    HashNum((long) NoLineSupp);
+    HashNum(DebugLevel);
+}
+
+/*
+ * Reads `Len' bytes, zero terminated, into a new string.
+ */
+
+static char *ReadStr(FILE *fh, unsigned long Len)
+{
+    char *Str;
+
+    if ((Str = malloc(Len + 1)))
+    {
+        if (fread(Str, 1, Len, fh) == Len)
+        {
+            Str[Len] = 0;
+            return (Str);
+        }
+        free(Str);
+    }
+    return (NULL);
+}
+
+/*
+ * Whether the file at `Path' has contents with the digest `Hex'.
+ */
+
+static int SameContents(const char *Path, const char *Hex)
+{
+    struct Digest Hash;
+    char Buf[DIGESTLEN + 1];
+    const char *Data;
+    unsigned long Size;
+    int Mapped;
+
+    if (!(Data = MapFile(Path, &Size, &Mapped)))
+        return (FALSE);
+
+    InitDigest(&Hash);
+    AddDigest(&Hash, Data, Size);
+    UnmapFile(Data, Size, Mapped);
+    DigestHex(&Hash, Buf);
+
+    return (!strcmp(Buf, Hex));
+}
+
+/*
+ * Reads an \input file noted in an entry, and checks whether it's
+ * still what it was.
+ */
+
+static int SameInput(FILE *fh)
+{
+    char Line[HEADLINELEN], Hex[DIGESTLEN + 1], Found[BUFSIZ];
+    char *Name = NULL, *Path = NULL;
+    unsigned long NameLen, PathLen;
+    int Same = FALSE;
+
+    if (fgets(Line, HEADLINELEN, fh) &&
+        (sscanf(Line, "%32s %lu %lu", Hex, &NameLen, &PathLen) == 3) &&
+        (NameLen < BUFSIZ) && (PathLen < BUFSIZ) &&
+        (Name = ReadStr(fh, NameLen)) && (Path = ReadStr(fh, PathLen)))
+    {
+        if (LocateFile(Name, Found, ".tex", &TeXInputs))
+            Same = PathLen && !strcmp(Found, Path) && SameContents(Found, Hex);
+        else
+            Same = !PathLen;
+    }
+
+    free(Name);
+    free(Path);
+    return (Same);
+}
+
+/*
+ * Writes out the results in the entry `Entry', if it exists and is up
+ * to date.
+ */
+
+static int Replay(struct CheckState *cs, const char *Entry, int *Retval)
+{
+    char Line[HEADLINELEN], *Out = NULL, *Err = NULL;
+    unsigned long i, NumDeps, OutLen, ErrLen;
+    int Ret, Valid = FALSE;
+    FILE *fh;
+
+    if (!(fh = fopen(Entry, "rb")))
+        return (FALSE);
+
+    if (fgets(Line, HEADLINELEN, fh) && !strcmp(Line, CACHEMAGIC) &&
+        fgets(Line, HEADLINELEN, fh) &&
+        (sscanf(Line, "%d %lu %lu %lu %lu %lu %lu %lu", &Ret,
+                &cs->ErrPrint, &cs->WarnPrint, &cs->UserSupp, &cs->LineSupp,
+                &NumDeps, &OutLen, &ErrLen) == 8))
+    {
+        for (Valid = TRUE, i = 0; Valid && (i < NumDeps); i++)
+            Valid = SameInput(fh);
+
+        Valid = Valid && (Out = ReadStr(fh, OutLen)) &&
+            (Err = ReadStr(fh, ErrLen));
+    }
+    fclose(fh);
+
+    if (Valid)
+    {
+        fwrite(Out, 1, OutLen, cs->OutputFile);
+        fwrite(Err, 1, ErrLen, MsgFile());
+        PrintSummary(cs);
+        if (Ret != EXIT_SUCCESS)
+            *Retval = Ret;
+    }
+    else
+    {
+        cs->ErrPrint = cs->WarnPrint = cs->UserSupp = cs->LineSupp = 0;
+    }
+
+    free(Out);
+    free(Err);
+    return (Valid);
+}
+
+/*
+ * Saves the results of checking a file, spooled in `Out' and `Err',
+ * as `Entry'.
+ */
+
+static void Store(struct CheckState *cs, const char *Entry,
+                  struct Stack *Deps, struct Spool *Out, struct Spool *Err,
+                  int Ret)
+{
+#ifdef HAVE_MKSTEMP
+    char *Tmp, Hex[DIGESTLEN + 1];
+    struct Dep *dep;
+    unsigned long i;
+    long OutLen, ErrLen;
+    int fd, Saved;
+    FILE *fh;
+
+    fflush(Out->fh);
+    fflush(Err->fh);
+    if (((OutLen = ftell(Out->fh)) < 0) || ((ErrLen = ftell(Err->fh)) < 0))
+        return;
+
+    if (!(Tmp = malloc(strlen(CacheDir) + 16)))
+        return;
+    strcpy(Tmp, CacheDir);
+    tackon(Tmp, "tmpXXXXXX");
+
+    if ((fd = mkstemp(Tmp)) >= 0)
+    {
+#ifdef USE_FCHMOD
+        fchmod(fd, EntryMode);
+#endif
+        if ((fh = fdopen(fd, "wb")))
+        {
+            fputs(CACHEMAGIC, fh);
+            fprintf(fh, "%d %lu %lu %lu %lu %lu %ld %ld\n", Ret,
+                    cs->ErrPrint, cs->WarnPrint, cs->UserSupp, cs->LineSupp,
+                    Deps->Used, OutLen, ErrLen);
+
+            for (i = 0; i < Deps->Used; i++)
+            {
+                dep = Deps->Data[i];
+                if (dep->Path)
+                    DigestHex(&dep->Hash, Hex);
+                else
+                    strcpy(Hex, "-");
+                fprintf(fh, "%s %lu %lu\n%s%s", Hex,
+                        (unsigned long) strlen(dep->Name),
+                        (unsigned long) (dep->Path ? strlen(dep->Path) : 0),
+                        dep->Name, dep->Path ? dep->Path : "");
+            }
+
+            CopySpool(Out, fh);
+            CopySpool(Err, fh);
+
+            Saved = !ferror(fh);
+            Saved = !fclose(fh) && Saved;
+            if (!Saved || rename(Tmp, Entry))
+                remove(Tmp);
+        }
+        else
+        {
+            close(fd);
+            remove(Tmp);
+        }
+    }
+
+    free(Tmp);
+#endif
+}
+
+/*
+ * Records that `cs' read the \input file `Name', now on top of the
+ * input stack as `fn', or that it couldn't be found (`fn' is NULL).
+ */
+
+void NoteInput(struct CheckState *cs, const char *Name,
+               const struct FileNode *fn)
+{
+    struct Dep *dep;
+
+    if (!cs->Deps)
+        return;
+
+    if (!(dep = calloc(1, sizeof(struct Dep))) ||
+        !(dep->Name = strdup(Name)) || (fn && !(dep->Path = strdup(fn->Name))))
+        PrintPrgErr(pmStrDupErr);
+
+    if (fn)
+    {
+        InitDigest(&dep->Hash);
+        AddDigest(&dep->Hash, fn->Data, fn->Size);
+    }
+
+    if (!StkPush(dep, cs->Deps))
+        PrintPrgErr(pmNoStackMem);
+}
+
+static void FreeDeps(struct Stack *Deps)
+{
+    struct Dep *dep;
+
+    while ((dep = StkPop(Deps)))
+    {
+        free(dep->Name);
+        free(dep->Path);
+        free(dep);
+    }
+    free(Deps->Data);
+}
+
+/*
+ * Checks the file `Name' with `cs', like CheckFile(), unless we have
+ * its results in the cache already.
+ */
+
+int CheckCached(struct CheckState *cs, const char *Name, int *Retval)
+{
+    char Path[BUFSIZ], Hex[DIGESTLEN + 1], *Entry;
+    struct Stack Deps = { NULL, 0, 0 };
+    struct Spool Out, Err;
+    struct Digest Key;
+    FILE *Output, *Status, *Msgs;
+    const char *Data;
+    unsigned long Size;
+    int Mapped, Ret, Spooled;
+
+    if (!LocateFile(Name, Path, ".tex", &TeXInputs) ||
+        !(Data = MapFile(Path, &Size, &Mapped)))
+    {
+        PrintPrgErr(pmNoTeXOpen, Name);
+        return (FALSE);
+    }
+
+    Key = ConfigHash;
+    AddDigestStr(&Key, Path);
+    AddDigest(&Key, Data, Size);
+    DigestHex(&Key, Hex);
+
+    if (!(Entry = malloc(strlen(CacheDir) + DIGESTLEN + 2)))
+        PrintPrgErr(pmNoStackMem);
+    strcpy(Entry, CacheDir);
+    tackon(Entry, Hex);
+
+    if (Replay(cs, Entry, Retval))
+    {
+        UnmapFile(Data, Size, Mapped);
+        free(Entry);
+        return (TRUE);
+    }
+
+    if (!PushData(Path, Data, Size, Mapped, &cs->InputStack))
+    {
+        UnmapFile(Data, Size, Mapped);
+        free(Entry);
+        return (FALSE);
+    }
+
+    /* Check it as usual, keeping a copy of everything we write */
+    if ((Spooled = OpenSpool(&Out)) && !(Spooled = OpenSpool(&Err)))
+        DrainSpool(&Out, NULL);
+
+    Output = cs->OutputFile;
+    Status = cs->StatusFile;
+    Msgs = MsgFile();
+    if (Spooled)
+    {
+        cs->OutputFile = Out.fh;
+        cs->StatusFile = NULL;
+        cs->Deps = &Deps;
+        SetMsgFile(Err.fh);
+    }
+
+    Ret = CheckInput(cs);
+
+    if (Spooled)
+    {
+        cs->OutputFile = Output;
+        cs->StatusFile = Status;
+        cs->Deps = NULL;
+        SetMsgFile(Msgs);
+
+        Store(cs, Entry, &Deps, &Out, &Err, Ret);
+        DrainSpool(&Out, Output);
+        DrainSpool(&Err, Msgs);
+        PrintSummary(cs);
+    }
+
+    if (Ret != EXIT_SUCCESS)
+        *Retval = Ret;
+
+    FreeDeps(&Deps);
+    free(Entry);
+    return (TRUE);
+}
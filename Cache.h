@@ -0,0 +1,40 @@
+/*
+ *  ChkTeX, result cache -- header file.
+ *  Copyright (C) 1995-96 Jens T. Berger Thielemann
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Contact the author at:
+ *              Jens Berger
+ *              Spektrumvn. 4
+ *              N-0666 Oslo
+ *              Norway
+ *              E-mail: <jensthi@ifi.uio.no>
+ *
+ *
+ */
+
+#ifndef CACHE_H
+#define CACHE_H 1
+
+#include "ChkTeX.h"
+#include "Utility.h"
+
+void SetupCache(void);
+int CheckCached(struct CheckState *cs, const char *Name, int *Retval);
+void NoteInput(struct CheckState *cs, const char *Name,
+               const struct FileNode *fn);
+
+#endif /* CACHE_H */
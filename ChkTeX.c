@@ -37,6 +37,8 @@
 #include "Utility.h"
 #include "FindErrs.h"
 #include "Resource.h"
+#include "Server.h"
+#include "Cache.h"
 #include <string.h>
 
 #undef MSG
@@ -46,21 +48,11 @@ struct ErrMsg PrgMsgs[pmMaxFault + 1] = {
     PRGMSGS {(enum ErrNum)pmMaxFault, etErr, TRUE, 0, INTERNFAULT}
 };
 
-struct Stack CharStack = {
-    0L
-}, InputStack =
-
-{
-0L}, EnvStack =
-
-{
-0L};
-
 /************************************************************************/
 
 const char BrOrder[NUMBRACKETS + 1] = "()[]{}";
 
-unsigned long Brackets[NUMBRACKETS];
+long TabWidth = 8;
 
 /************************************************************************/
 
@@ -71,8 +63,8 @@ unsigned long Brackets[NUMBRACKETS];
  */
 
 
-NEWBUF(TmpBuffer, BUFSIZ);
-NEWBUF(ReadBuffer, BUFSIZ);
+NEWBUF(TmpBuffer);
+NEWBUF(ReadBuffer);
 
 static const char *Banner =
     "ChkTeX v" PACKAGE_VERSION " - Copyright 1995-96 Jens T. Berger Thielemann.\n"
@@ -133,7 +125,8 @@ static const char *HelpText =
     "                               Template\n"
     "                               ~~~~~~~~\n"
     "chktex [-hiqrW] [-v[0-...]] [-l <rcfile>] [-[wemn] <[1-42]|all>]\n"
-    "       [-d[0-...]] [-p <name>] [-o <outfile>] [-[btxgI][0|1]]\n"
+    "       [-d[0-...]] [-j <jobs>] [-p <name>] [-o <outfile>]\n"
+    "       [-[btxgI][0|1]]\n"
     "       file1 file2 ...\n"
     "\n"
     "----------------------------------------------------------------------\n"
@@ -146,6 +139,14 @@ static const char *HelpText =
     "    -l  --localrc   : Read local .chktexrc formatted file.\n"
     "    -d  --debug     : Debug information. Give it a number.\n"
     "    -r  --reset     : Reset settings to default.\n"
+    "    -j  --jobs      : Check this many files at the same time.\n"
+    "        --serve     : Check documents sent on stdin, or the socket\n"
+    "                      given as --serve=PATH, until told to quit.\n"
+    "        --cache     : Keep results in the directory given as\n"
+    "                      --cache=DIR, and reuse them for unchanged files.\n"
+    "        --config    : Use the settings saved in FILE, given as\n"
+    "                      --config=FILE, instead of any resource files.\n"
+    "                      Make FILE with --compile-config=FILE.\n"
     "\n"
     "Muting warning messages:\n"
     "~~~~~~~~~~~~~~~~~~~~~~~~\n"
@@ -198,7 +199,6 @@ char VerbNormal[] = "%k %n in %f line %l: %m\n" "%r%s%t\n" "%u\n";
 
 #define DEF(type, name, value)  type name = value
 OPTION_DEFAULTS;
-STATE_VARS;
 #undef DEF
 FILE *OutputFile = NULL;
 
@@ -214,6 +214,11 @@ static int ParseArgs(int argc, char **argv);
 static void ShowIntStatus(void);
 static int OpenOut(void);
 static int ShiftArg(char **Argument);
+static int CheckFile(struct CheckState *cs, const char *Name, int *Retval);
+static void CheckFiles(char **Names, int Count, int *Retval);
+#if USE_THREADS
+static void CheckFilesParallel(char **Names, int Count, int *Retval);
+#endif
 
 
 /*
@@ -231,6 +236,7 @@ static void AddStars(struct WordList *wl)
         CmdLen = strlen(Data);
         if (Data[CmdLen - 1] != '*')
         {
+            GROWBUF(TmpBuffer, CmdLen + 2);
             strcpy(TmpBuffer, Data);
             strcat(TmpBuffer, "*");
             InsertWord(TmpBuffer, wl);
@@ -257,6 +263,8 @@ static void SetupLists(void)
 
 #define ThisItem ((char *) AbbrevCase.Stack.Data[i])
 
+    /* We capitalise the words in place */
+    UnshareWords(&AbbrevCase);
     FORWL(i, AbbrevCase)
     {
         if (isalpha((unsigned char)ThisItem[0]))
@@ -267,6 +275,7 @@ static void SetupLists(void)
         }
         InsertWord(ThisItem, &Abbrev);
     }
+
 }
 
 #define NOCOMMON(a,b) NoCommon(&a,#a,&b,#b)
@@ -289,75 +298,37 @@ NoCommon(struct WordList *a, const char *aName,
 }
 
 /*
- * Expands the tabs in a string to regular intervals sized
- * TSize.
+ * Finds --config in `argv'; it decides whether the resource files are
+ * read at all, so it has to be seen before any other option.
  */
 
-static void ExpandTabs(char *From, char *To, long TSize, long MaxDiff)
+static const char *FindConfigArg(int argc, char **argv)
 {
-    char *Next;
-    char *Orig;
-    unsigned long Diff;
-    static short HasExpandedTooLong = 0;
-
-    Next = From;
-    Orig = To;
+    int i;
 
-    while ((Next = strchr(From, '\t')))
+    for (i = 1; (i < argc) && strcmp(argv[i], "--"); i++)
     {
-        if ((Diff = Next - From))
-        {
-            strncpy(To, From, Diff);
-            To += Diff;
-            Diff = TSize - ((To - Orig) % TSize);
-        }
-        else
-            Diff = TSize;
-
-        /* Make sure we don't expand this buffer out of the memory we
-         * have allocated for it. */
-        if ( Diff > MaxDiff+1 )
-        {
-            Diff = MaxDiff+1;
-            if ( !HasExpandedTooLong )
-            {
-                PrintPrgErr(pmTabExpands, BUFSIZ);
-            }
-            HasExpandedTooLong = 1;
-        }
-        MaxDiff -= (Diff-1);
-
-        memset(To, ' ', Diff);
-        To += Diff;
-
-        From = ++Next;
+        if (!strncmp(argv[i], "--config=", 9))
+            return (&argv[i][9]);
+        if (!strcmp(argv[i], "--config") && (i + 1 < argc))
+            return (argv[i + 1]);
     }
-    strcpy(To, From);
+    return (NULL);
 }
 
+/*
+ * Reads the resource files (or the compiled configuration given with
+ * --config), and then the options in `argv'. Returns the index of the
+ * first file name in `argv', or 0 if the options were faulty.
+ */
 
-int main(int argc, char **argv)
+int ReadSettings(int argc, char **argv)
 {
-    int retval = EXIT_FAILURE, ret, CurArg;
-    unsigned long Count;
-    int StdInUse = FALSE;
-    long Tab = 8;
-
-#ifdef __LOCALIZED
+    const char *Compiled;
+    int CurArg;
 
-    InitStrings();
-#endif
-
-    OutputFile = stdout;
-#ifdef KPATHSEA
-    kpse_set_program_name(argv[0], "chktex");
-    PrgName = kpse_program_name;
-#ifdef WIN32
-    setmode(fileno(stdout), _O_BINARY);
-#endif
-#else
-    PrgName = argv[0];
-#endif
+    GROWBUF(TmpBuffer, BUFSIZ);
+    GROWBUF(ReadBuffer, BUFSIZ);
 
 #undef KEY
 #undef LCASE
@@ -368,10 +339,15 @@ int main(int argc, char **argv)
 #define LIST(a)
 #define LNEMPTY(a) InsertWord("", &a);
 
-    RESOURCE_INFO
+    if ((Compiled = FindConfigArg(argc, argv)))
+        LoadCompiled(Compiled);
+    else
+    {
+        RESOURCE_INFO
 
-    while (SetupVars())
-        ReadRC(ConfigFile);
+        while (SetupVars())
+            ReadRC(ConfigFile);
+    }
 
     if (CmdLine.Stack.Used)
     {
@@ -381,12 +357,84 @@ int main(int argc, char **argv)
 
     if ((CurArg = ParseArgs((unsigned long) argc, argv)))
     {
-        retval = EXIT_SUCCESS;
         if (CmdLine.Stack.Used)
         {
             ParseArgs(CmdLine.Stack.Used, (char **) CmdLine.Stack.Data);
             CmdLine.Stack.Used = 1L;
         }
+    }
+
+    return (CurArg);
+}
+
+/*
+ * Gets the lists and regular expressions ready for checking, once all
+ * settings have been read.
+ */
+
+void FinishSettings(void)
+{
+    /* A compiled configuration has been through this already */
+    if (!CompiledConfig)
+        SetupLists();
+    SetupRegexes();
+    SetupCommands();
+    SetupAbbrevs();
+    SetupDots();
+    SetupPlain();
+    SetupUserWarn();
+    if (QuoteStyle)
+    {
+        if (!strcasecmp(QuoteStyle, "LOGICAL"))
+            Quote = quLogic;
+        else if (!strcasecmp(QuoteStyle, "TRADITIONAL"))
+            Quote = quTrad;
+        else
+        {
+            PrintPrgErr(pmQuoteStyle, QuoteStyle);
+            Quote = quTrad;
+        }
+    }
+
+    if (DebugLevel)
+        ShowIntStatus();
+
+    NOCOMMON(Italic, NonItalic);
+    NOCOMMON(Italic, ItalCmd);
+    NOCOMMON(LowDots, CenterDots);
+
+    if (TabSize && isdigit((unsigned char)*TabSize))
+        TabWidth = strtol(TabSize, NULL, 10);
+}
+
+/*
+ * The program itself; main() just calls us. Everything but main()
+ * also goes into the library, see ChkTeXLib.h.
+ */
+
+int ChkTeXMain(int argc, char **argv)
+{
+    int retval = EXIT_FAILURE, CurArg;
+
+#ifdef __LOCALIZED
+
+    InitStrings();
+#endif
+
+    OutputFile = stdout;
+#ifdef KPATHSEA
+    kpse_set_program_name(argv[0], "chktex");
+    PrgName = kpse_program_name;
+#ifdef WIN32
+    setmode(fileno(stdout), _O_BINARY);
+#endif
+#else
+    PrgName = argv[0];
+#endif
+
+    if ((CurArg = ReadSettings(argc, argv)))
+    {
+        retval = EXIT_SUCCESS;
 
         if (!Quiet || LicenseOnly)
             fprintf(stderr, "%s", Banner);
@@ -405,7 +453,8 @@ int main(int argc, char **argv)
 
         SetupTerm();
 
-        if ((UsingStdIn && StdInTTY && !Quiet) || LicenseOnly)
+        if ((UsingStdIn && StdInTTY && !Quiet && !CompileName) ||
+            LicenseOnly)
         {
             fprintf(stderr, "%s", BigBanner);
         }
@@ -417,95 +466,314 @@ int main(int argc, char **argv)
         {
             fprintf(stderr, "%s", Distrib);
         }
+        else if (CompileName)
+        {
+            if (!CompiledConfig)
+                SetupLists();
+            WriteCompiled(CompileName);
+        }
         else
         {
-            SetupLists();
-            if (QuoteStyle)
+            FinishSettings();
+            if (CacheDir)
+                SetupCache();
+
+            if (ServeMode)
             {
-                if (!strcasecmp(QuoteStyle, "LOGICAL"))
-                    Quote = quLogic;
-                else if (!strcasecmp(QuoteStyle, "TRADITIONAL"))
-                    Quote = quTrad;
-                else
+                NoMapping = TRUE;
+                retval = Serve(ServeSocket);
+            }
+            else if (OpenOut())
+            {
+#if USE_THREADS
+                if (!UsingStdIn && (Jobs > 1) && (argc - CurArg > 1))
                 {
-                    PrintPrgErr(pmQuoteStyle, QuoteStyle);
-                    Quote = quTrad;
+                    NoMapping = TRUE;
+                    CheckFilesParallel(&argv[CurArg], argc - CurArg, &retval);
                 }
+                else
+#endif
+                    CheckFiles(&argv[CurArg], argc - CurArg, &retval);
             }
+            ShowRegexStats();
+        }
+    }
+    return retval;
+}
+
+/*
+ * Checks a single document, `Name' or stdin if that is NULL, with
+ * `cs'. `*Retval' is set to failure if any errors were found.
+ *
+ * Returns FALSE if the document couldn't be read; no further files
+ * should be checked then.
+ */
+
+static int CheckFile(struct CheckState *cs, const char *Name, int *Retval)
+{
+    int ret;
+
+    ResetCheckState(cs);
 
-            if (DebugLevel)
-                ShowIntStatus();
+    if (Name && CacheDir)
+        return (CheckCached(cs, Name, Retval));
 
-            NOCOMMON(Italic, NonItalic);
-            NOCOMMON(Italic, ItalCmd);
-            NOCOMMON(LowDots, CenterDots);
+    if (Name)
+    {
+        if (!PushFileName(Name, &cs->InputStack))
+            return (FALSE);
+    }
+    else
+        PushFile("stdin", stdin, &cs->InputStack);
+
+    if ((ret = CheckInput(cs)) != EXIT_SUCCESS)
+        *Retval = ret;
+
+    return (TRUE);
+}
+
+/*
+ * Checks the `Count' files in `Names' one after another, or stdin if
+ * there are none.
+ */
 
-            if (TabSize && isdigit((unsigned char)*TabSize))
-                Tab = strtol(TabSize, NULL, 10);
+static void CheckFiles(char **Names, int Count, int *Retval)
+{
+    struct CheckState *cs;
+    int i;
 
-            if (OpenOut())
+    if ((cs = NewCheckState(OutputFile)))
+    {
+        if (UsingStdIn)
+            CheckFile(cs, NULL, Retval);
+        else
+        {
+            for (i = 0; i < Count; i++)
             {
-                for (;;)
-                {
-                    for (Count = 0; Count < NUMBRACKETS; Count++)
-                        Brackets[Count] = 0L;
+                if (!CheckFile(cs, Names[i], Retval))
+                    break;
+            }
+        }
+        FreeCheckState(cs);
+    }
+}
 
-#define DEF(type, name, value) name = value
-                    STATE_VARS;
-#undef DEF
-                    if (UsingStdIn)
-                    {
-                        if (StdInUse)
-                            break;
-                        else
-                        {
-                            StdInUse = TRUE;
-                            PushFile("stdin", stdin, &InputStack);
-                        }
-                    }
-                    else
-                    {
-                        if (CurArg <= argc)
-                        {
-                            const char *filename = NULL;
-                            if (CurArg < argc)
-                                filename = argv[CurArg++];
+#if USE_THREADS
 
-                            if (!PushFileName(filename, &InputStack))
-                                break;
-                        }
-                    }
+/*
+ * For -j, each file becomes a job. Its output is spooled, and written
+ * in the order the files were given once the job is done; the result
+ * is the same as if we'd checked them one after another.
+ */
 
-                    if (StkTop(&InputStack) && OutputFile)
-                    {
-                        while (!ferror(OutputFile)
-                               && StkTop(&InputStack)
-                               && !ferror(CurStkFile(&InputStack))
-                               && FGetsStk(ReadBuffer, BUFSIZ - 1,
-                                           &InputStack))
-                        {
+struct Job
+{
+    const char *Name;
+    unsigned long Size;         /* The biggest jobs are started first */
+    struct Spool Out, Err;      /* Held back stdout/stderr output */
+    int Retval;
+    int Found;                  /* Whether the file could be read */
+    int Done;
+};
 
-                            /* Make all spaces ordinary spaces */
+struct Pool
+{
+    struct Job *Jobs;
+    struct Job **Queue;         /* Jobs sorted by size */
+    int NumJobs, Next;
+    int Stop;                   /* Don't start any more jobs */
+    pthread_mutex_t Lock;
+    pthread_cond_t Finished;
+};
 
-                            strrep(ReadBuffer, '\n', ' ');
-                            strrep(ReadBuffer, '\r', ' ');
-                            ExpandTabs(ReadBuffer, TmpBuffer, Tab, BUFSIZ - 1 - strlen(ReadBuffer) );
-                            strcpy(ReadBuffer, TmpBuffer);
+static int CompareJobs(const void *a, const void *b)
+{
+    const struct Job *ja = *(const struct Job **) a;
+    const struct Job *jb = *(const struct Job **) b;
 
-                            strcat(ReadBuffer, " ");
-                            ret = FindErr(ReadBuffer, CurStkLine(&InputStack));
-                            if ( ret != EXIT_SUCCESS ) {
-                                retval = ret;
-                            }
-                        }
+    if (ja->Size != jb->Size)
+        return ((ja->Size > jb->Size) ? -1 : 1);
+    return ((ja > jb) - (ja < jb));
+}
 
-                        PrintStatus(CurStkLine(&InputStack));
-                    }
-                }
+static void *Worker(void *Data)
+{
+    struct Pool *pool = Data;
+    struct CheckState *cs;
+    struct Job *job;
+
+    if ((cs = NewCheckState(NULL)))
+    {
+        for (;;)
+        {
+            pthread_mutex_lock(&pool->Lock);
+            if (!pool->Stop && (pool->Next < pool->NumJobs))
+                job = pool->Queue[pool->Next++];
+            else
+                job = NULL;
+            pthread_mutex_unlock(&pool->Lock);
+
+            if (!job)
+                break;
+
+            if (!OpenSpool(&job->Out) || !OpenSpool(&job->Err))
+                PrintPrgErr(pmNoSpool, job->Name);
+
+            SetMsgFile(job->Err.fh);
+            cs->OutputFile = job->Out.fh;
+            cs->StatusFile = job->Err.fh;
+            job->Found = CheckFile(cs, job->Name, &job->Retval);
+            SetMsgFile(NULL);
+
+            pthread_mutex_lock(&pool->Lock);
+            job->Done = TRUE;
+            pthread_cond_broadcast(&pool->Finished);
+            pthread_mutex_unlock(&pool->Lock);
+        }
+        FreeCheckState(cs);
+    }
+    return (NULL);
+}
+
+/*
+ * Checks the `Count' files in `Names' using up to `Jobs' threads.
+ * Falls back to CheckFiles() if we can't get any threads going.
+ */
+
+static void CheckFilesParallel(char **Names, int Count, int *Retval)
+{
+    struct Pool pool;
+    struct Job *job;
+    pthread_t *Threads;
+    int i, NumThreads = 0;
+    char NameBuf[BUFSIZ];
+
+    pool.Jobs = calloc((size_t) Count, sizeof(struct Job));
+    pool.Queue = calloc((size_t) Count, sizeof(struct Job *));
+    Threads = calloc((size_t) min(Jobs, Count), sizeof(pthread_t));
+
+    if (!pool.Jobs || !pool.Queue || !Threads)
+    {
+        free(pool.Jobs);
+        free(pool.Queue);
+        free(Threads);
+        CheckFiles(Names, Count, Retval);
+        return;
+    }
+
+    for (i = 0; i < Count; i++)
+    {
+        job = &pool.Jobs[i];
+        job->Name = Names[i];
+        job->Retval = EXIT_SUCCESS;
+        if (LocateFile(Names[i], NameBuf, ".tex", &TeXInputs))
+            job->Size = FileSize(NameBuf);
+        pool.Queue[i] = job;
+    }
+    qsort(pool.Queue, (size_t) Count, sizeof(struct Job *), CompareJobs);
+
+    pool.NumJobs = Count;
+    pool.Next = 0;
+    pool.Stop = FALSE;
+    pthread_mutex_init(&pool.Lock, NULL);
+    pthread_cond_init(&pool.Finished, NULL);
+
+    while ((NumThreads < min(Jobs, Count)) &&
+           !pthread_create(&Threads[NumThreads], NULL, Worker, &pool))
+        NumThreads++;
+
+    if (NumThreads)
+    {
+        /* Write the output in argv order, as soon as it is available */
+        for (i = 0; i < Count; i++)
+        {
+            job = &pool.Jobs[i];
+
+            pthread_mutex_lock(&pool.Lock);
+            while (!job->Done)
+                pthread_cond_wait(&pool.Finished, &pool.Lock);
+            pthread_mutex_unlock(&pool.Lock);
+
+            DrainSpool(&job->Out, OutputFile);
+            DrainSpool(&job->Err, stderr);
+
+            if (job->Retval != EXIT_SUCCESS)
+                *Retval = job->Retval;
+
+            if (!job->Found)
+            {
+                pthread_mutex_lock(&pool.Lock);
+                pool.Stop = TRUE;
+                pthread_mutex_unlock(&pool.Lock);
+                break;
             }
         }
+
+        while (NumThreads)
+            pthread_join(Threads[--NumThreads], NULL);
+
+        /* Whatever was checked after a file we couldn't read is dropped */
+        for (i = 0; i < Count; i++)
+        {
+            DrainSpool(&pool.Jobs[i].Out, NULL);
+            DrainSpool(&pool.Jobs[i].Err, NULL);
+        }
     }
-    return retval;
+    else
+        CheckFiles(Names, Count, Retval);
+
+    pthread_cond_destroy(&pool.Finished);
+    pthread_mutex_destroy(&pool.Lock);
+    free(Threads);
+    free(pool.Queue);
+    free(pool.Jobs);
+}
+
+#endif /* USE_THREADS */
+
+/*
+ * Where program messages go. Normally that's stderr, but the workers
+ * of -j spool theirs with the rest of the output for their file.
+ */
+
+#if USE_THREADS
+static pthread_key_t MsgKey;
+static pthread_once_t MsgKeyOnce = PTHREAD_ONCE_INIT;
+
+static void MakeMsgKey(void)
+{
+    pthread_key_create(&MsgKey, NULL);
+}
+#else
+static FILE *MsgFh = NULL;
+#endif
+
+/*
+ * Sends the program messages of the calling thread to `fh', or back
+ * to stderr if that is NULL.
+ */
+
+void SetMsgFile(FILE *fh)
+{
+#if USE_THREADS
+    pthread_once(&MsgKeyOnce, MakeMsgKey);
+    pthread_setspecific(MsgKey, fh);
+#else
+    MsgFh = fh;
+#endif
+}
+
+FILE *MsgFile(void)
+{
+    FILE *fh;
+
+#if USE_THREADS
+    pthread_once(&MsgKeyOnce, MakeMsgKey);
+    fh = pthread_getspecific(MsgKey);
+#else
+    fh = MsgFh;
+#endif
+    return (fh ? fh : stderr);
 }
 
 /*
@@ -520,6 +788,7 @@ static int OpenOut(void)
     {
         if (BackupOut && fexists(OutputName))
         {
+            GROWBUF(TmpBuffer, strlen(OutputName) + strlen(BAKAPPENDIX) + 1);
             strcpy(TmpBuffer, OutputName);
             AddAppendix(TmpBuffer, BAKAPPENDIX);
 
@@ -558,7 +827,7 @@ static int OpenOut(void)
 #ifndef STRIP_DEBUG
 static void ShowWL(const char *Name, const struct WordList *wl)
 {
-    unsigned long i, j, percent;
+    unsigned long i, percent;
 
     fprintf(stderr, "Name: %12s", Name);
 
@@ -567,14 +836,9 @@ static void ShowWL(const char *Name, const struct WordList *wl)
         fprintf(stderr, ", MaxLen: %3ld, Entries: %3ld, ",
                 wl->MaxLen, wl->Stack.Used);
 
-        if (wl->Hash.Index && wl->Stack.Used)
+        if (wl->Hash.Size && wl->Stack.Used)
         {
-            for (i = j = 0; i < HASH_SIZE; i++)
-            {
-                if (wl->Hash.Index[i])
-                    j++;
-            }
-            percent = (j * 10000) / wl->Stack.Used;
+            percent = (wl->Hash.Used * 10000) / wl->Hash.Size;
 
 
             fprintf(stderr, "Hash usage: %3ld.%02ld%%",
@@ -704,6 +968,8 @@ static void ShowIntStatus(void)
 
 static void ResetStacks(void)
 {
+    /* All the words go at once; the lists then forget them */
+    FreeArena(&ConfigArena);
     RESOURCE_INFO
 }
 
@@ -797,6 +1063,11 @@ static int ParseArgs(int argc, char **argv)
         {"pipeverb", optional_argument, 0L, 'V'},
         {"debug", required_argument, 0L, 'd'},
         {"reset", no_argument, 0L, 'r'},
+        {"jobs", required_argument, 0L, 'j'},
+        {"serve", optional_argument, 0L, 'S'},
+        {"cache", required_argument, 0L, 'C'},
+        {"compile-config", required_argument, 0L, 'P'},
+        {"config", required_argument, 0L, 'K'},
         {"quiet", no_argument, 0L, 'q'},
         {"license", no_argument, 0L, 'i'},
         {"splitchar", required_argument, 0L, 's'},
@@ -817,7 +1088,7 @@ static int ParseArgs(int argc, char **argv)
     int option_index = 0L, c, i, nextc, ErrType;
 
     int Retval = FALSE, InUse;
-    int Success, Foo;
+    int Success, Foo = FALSE;
     long Err, Verb = 1, PipeVerb = 1;
 
     enum
@@ -833,7 +1104,7 @@ static int ParseArgs(int argc, char **argv)
 
     while (!ArgErr &&
            ((c = getopt_long((int) argc, argv,
-                             "b::d:e:f:g::hH::I::il:m:n:Lo:p:qrs:t::v::V::w:Wx::",
+                             "b::d:e:f:g::hH::I::ij:l:m:n:Lo:p:qrs:t::v::V::w:Wx::",
                              long_options, &option_index)) != EOF))
     {
         while (c)
@@ -868,6 +1139,38 @@ static int ParseArgs(int argc, char **argv)
 #endif
 
                 break;
+            case 'j':
+                nextc = ParseNumArg(&Jobs, 1, &optarg);
+                if (Jobs < 1)
+                    Jobs = 1;
+                break;
+            case 'S':
+                ServeMode = TRUE;
+                if (optarg && !(ServeSocket = strdup(optarg)))
+                {
+                    PrintPrgErr(pmStrDupErr);
+                    ArgErr = aeMem;
+                }
+                break;
+            case 'C':
+                if (!(CacheDir = strdup(optarg)))
+                {
+                    PrintPrgErr(pmStrDupErr);
+                    ArgErr = aeMem;
+                }
+                break;
+            case 'P':
+                if (!(CompileName = strdup(optarg)))
+                {
+                    PrintPrgErr(pmStrDupErr);
+                    ArgErr = aeMem;
+                }
+                break;
+            case 'K':
+                /* Already loaded by ReadSettings(), if spelt out */
+                if (!CompiledConfig)
+                    PrintPrgErr(pmCompiledArg);
+                break;
             case 'i':
                 LicenseOnly = TRUE;
 
@@ -922,7 +1225,7 @@ static int ParseArgs(int argc, char **argv)
 
             case 'g':
                 nextc = ParseBoolArg(&GlobalRC, &optarg);
-                if (!GlobalRC)
+                if (!GlobalRC && !CompiledConfig)
                 {
                     ResetStacks();
                 }
@@ -1065,12 +1368,12 @@ void PrintPrgErr(enum PrgErrNum Error, ...)
             Type = "ERROR";
             break;
         }
-        fprintf(stderr, "%s: %s -- ", PrgName, Type);
+        fprintf(MsgFile(), "%s: %s -- ", PrgName, Type);
 
         va_start(MsgArgs, Error);
-        vfprintf(stderr, PrgMsgs[Error].Message, MsgArgs);
+        vfprintf(MsgFile(), PrgMsgs[Error].Message, MsgArgs);
         va_end(MsgArgs);
-        fputc('\n', stderr);
+        fputc('\n', MsgFile());
 
         if (PrgMsgs[Error].Type == etErr)
             exit(EXIT_FAILURE);
@@ -1082,6 +1385,6 @@ void ErrPrintf(const char *fmt, ...)
     va_list MsgArgs;
 
     va_start(MsgArgs, fmt);
-    vfprintf(stderr, fmt, MsgArgs);
+    vfprintf(MsgFile(), fmt, MsgArgs);
     va_end(MsgArgs);
 }
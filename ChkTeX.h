@@ -156,9 +156,17 @@
 
 #define NUMBRACKETS          6
 
-#define NEWBUF(name,len) \
-static char _ ## name [len  + (WALLBYTES<<1)] = {0};  \
-char *name = &_ ## name[WALLBYTES]
+/*
+ * Buffers which grow on demand, see GrowBuf(). Each one is padded with
+ * WALLBYTES zeroed bytes at either end, so we may safely peek a little
+ * outside of it. Nothing is allocated until the first GROWBUF().
+ */
+
+#define NEWBUF(name) \
+char *name = NULL; \
+unsigned long name ## Size = 0
+
+#define GROWBUF(name,len)  GrowBuf(&name, &name ## Size, len)
 
 #define INTFAULTMSG "INTERNAL FAULT OCCURED! PLEASE SUBMIT A BUG REPORT!\n"
 
@@ -257,11 +265,23 @@ DEBUGBITS(Debug_BIT)
  MSG(pmRegexMatchingError,  etErr,  TRUE, 0,\
      "PCRE matching error %d.\n") \
  MSG(pmSuppTooHigh,  etWarn,  TRUE, 0,\
-     "Warning %d is numbered too high (max %d) and won't be suppressed.\n") \
-MSG(pmLongLines,  etWarn,  TRUE, 0,\
-     "ChkTeX does not handle lines over %d bytes correctly.  Some errors and line numbers may be wrong in this file.") \
-MSG(pmTabExpands,  etWarn,  TRUE, 0,\
-     "ChkTeX could not fully expand tabs because the resulting line would be more than %d bytes.  Some errors and line numbers may be wrong in this file.")
+     "Warning %d is numbered too high (max %d) and won't be suppressed.\n")\
+ MSG(pmNoSpool,     etErr,  TRUE, 0,\
+     "Unable to buffer the output for `%s'.")\
+ MSG(pmServeSocket, etErr,  TRUE, 0,\
+     "Unable to serve on the socket `%s'.")\
+ MSG(pmNoSockets,   etErr,  TRUE, 0,\
+     "This version doesn't support sockets; use --serve without one.")\
+ MSG(pmCompiledOpen, etErr, TRUE, 0,\
+     "Unable to read the compiled configuration `%s'.")\
+ MSG(pmCompiledBad, etErr,  TRUE, 0,\
+     "`%s' is not a configuration compiled by this version of ChkTeX.")\
+ MSG(pmCompiledWrite, etErr, TRUE, 0,\
+     "Unable to write the compiled configuration `%s'.")\
+ MSG(pmCompiledRC,  etWarn, TRUE, 0,\
+     "Not reading `%s'; the settings come from a compiled configuration.")\
+ MSG(pmCompiledArg, etWarn, TRUE, 0,\
+     "--config is only understood in full, and on the command line.")
 
 #undef MSG
 #define MSG(num, type, inuse, ctxt, text) num,
@@ -273,10 +293,24 @@ enum PrgErrNum
 
 extern struct ErrMsg PrgMsgs[pmMaxFault + 1];
 
+/*
+ * A line with entries of CharStack or EnvStack on it, which they all
+ * share. While the line is being checked, Text is the RealBuf of the
+ * CheckState; it's copied only if entries are left once we're done
+ * with it. See ThisLine() and RetireLine().
+ */
+
+struct LineRef
+{
+    unsigned long Refs;
+    char *Text;
+    int Owned;                  /* Whether Text is a copy of our own */
+};
+
 struct ErrInfo
 {
-    char *Data;
-    const char *LineBuf;
+    char *Data;                 /* In the Names of its ErrStack */
+    struct LineRef *LineRef;
     const char *File;
     unsigned long Line, Column, ErrLen;
     enum
@@ -289,13 +323,27 @@ struct ErrInfo
     } Flags;
 };
 
+/*
+ * A stack of ErrInfos, kept in the array itself, their Data following
+ * each other in Names. An entry popped off is valid up to the next
+ * push. See PushErr().
+ */
+
+struct ErrStack
+{
+    struct ErrInfo *Data;
+    unsigned long Size, Used;
+    char *Names;
+    unsigned long NamesSize, NamesUsed;
+};
+
 extern char *ReadBuffer;
-extern char *CmdBuffer;
 extern char *TmpBuffer;
+extern unsigned long ReadBufferSize, TmpBufferSize;
 
 extern const char BrOrder[NUMBRACKETS + 1];
 
-extern unsigned long Brackets[NUMBRACKETS];
+extern long TabWidth;
 
 
 extern FILE *OutputFile, *InputFile;
@@ -323,8 +371,14 @@ extern FILE *OutputFile, *InputFile;
   DEF(char *, PipeOutputFormat, NULL); \
   DEF(const char *, Delimit, ":"); \
   DEF(long,  DebugLevel, 0); \
-  DEF(int,  NoLineSupp, FALSE)
-
+  DEF(int,  NoLineSupp, FALSE); \
+  DEF(long,  Jobs, 1); \
+  DEF(int,  ServeMode, FALSE); \
+  DEF(const char *, ServeSocket, NULL); \
+  DEF(const char *, CacheDir, NULL); \
+  DEF(const char *, CompileName, NULL)
+
+/* What FindErr() carries between lines; see also Recheck.c */
 #define STATE_VARS \
     DEF(enum ItState, ItState, itOff); /* Are we doing italics? */      \
   DEF(int, AtLetter, FALSE); /* Whether `@' is a letter or not. */      \
@@ -341,9 +395,7 @@ extern FILE *OutputFile, *InputFile;
 
 #define DEF(type, name, value) extern type name
 OPTION_DEFAULTS;
-STATE_VARS;
 #undef DEF
-extern struct Stack CharStack, InputStack, EnvStack;
 
 enum Quote
 {
@@ -354,10 +406,87 @@ enum Quote
 extern enum Quote Quote;
 extern int StdInTTY, StdOutTTY, UsingStdIn;
 
-int main(int argc, char **argv);
+int ChkTeXMain(int argc, char **argv);
+int ReadSettings(int argc, char **argv);
+void FinishSettings(void);
 void PrintPrgErr(enum PrgErrNum, ...);
 void ErrPrintf(const char *fmt, ...);
+void SetMsgFile(FILE *fh);
+FILE *MsgFile(void);
 
 extern char *PrgName;
 
+#include "Utility.h"
+#include "ChkTeXLib.h"
+
+/*
+ * Everything which changes while we check a document. The
+ * configuration (word lists, options, messages) is only read while
+ * checking, so several documents may be checked at the same time,
+ * each with a struct CheckState of its own. See NewCheckState().
+ */
+
+struct CheckState
+{
+#define DEF(type, name, value) type name
+    STATE_VARS;
+#undef DEF
+
+    struct Stack InputStack;
+    struct ErrStack CharStack, EnvStack;
+    struct LineRef *CurLine;    /* The current line, if anything uses it */
+    unsigned long Brackets[NUMBRACKETS];
+
+    FILE *OutputFile;           /* Where the errors go */
+    FILE *StatusFile;           /* Where the summary goes */
+
+    /* Takes the errors instead of OutputFile if set; see ChkTeXLib.h */
+    ChkTeXReport Report;
+    void *ReportData;
+    char *MsgBuf;               /* The message handed to Report */
+    unsigned long MsgBufSize;
+    int FoundErr;               /* Whether the last line had any errors */
+
+    int LastWasComment, SeenSpace;
+    int ItFlag, MathFlag;
+
+    /* Suppressions for the current line; see FileSuppressions */
+    uint64_t LineSuppressions, UserLineSuppressions;
+
+    unsigned long Line;         /* Line we're currently checking */
+    char *BufPtr;               /* Position within Buf */
+
+    /*
+     * The current line as shown to the user, and as checked. The
+     * others are scratch buffers; all of them grow with the line.
+     * See GrowBuf().
+     */
+    char *RealBuf, *Buf, *CmdBuffer, *ArgBuffer, *TmpBuffer, *VBStr;
+    unsigned long RealBufSize, BufSize, CmdBufferSize, ArgBufferSize,
+        TmpBufferSize, VBStrSize;
+
+    /* UserWarn words found in the current line; see CheckRest() */
+    struct WarnMatch *WarnMatches;
+    unsigned long NumWarnMatches, MaxWarnMatches;
+
+    /* UserWarnRegex patterns worth trying; see FindLiterals() */
+    unsigned long *RegexLive;
+    struct RegexStat *RegexStats;
+    unsigned long RegexLines;
+    void *RegexData;            /* Space for matching; see ExecRegex() */
+
+    /* SilentCase results of the commands seen; see CheckSilentRegex() */
+    struct Hash SilentCache;
+
+    /* Remembered for reports made after the input stack is empty */
+    const char *LastName;
+    unsigned long LastLine;
+
+    /* Names of the files popped off InputStack; see FGetsStk() */
+    struct Stack OldNames;
+
+    /* The \input files read, if the results are cached; see Cache.c */
+    struct Stack *Deps;
+};
+
 #endif /* CHKTEX_H */
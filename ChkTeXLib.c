@@ -0,0 +1,107 @@
+/*
+ *  ChkTeX, library interface.
+ *  Copyright (C) 1995-96 Jens T. Berger Thielemann
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Contact the author at:
+ *              Jens Berger
+ *              Spektrumvn. 4
+ *              N-0666 Oslo
+ *              Norway
+ *              E-mail: <jensthi@ifi.uio.no>
+ *
+ *
+ */
+
+#include "ChkTeX.h"
+#include "ChkTeXLib.h"
+#include "FindErrs.h"
+#include "Utility.h"
+#include "Recheck.h"
+
+static int Initialized = FALSE;
+
+int ChkTeXInit(int argc, char **argv)
+{
+    static char *DefaultArgs[] = { "chktex", NULL };
+
+    if (!Initialized)
+    {
+        if (argc < 1)
+        {
+            argc = 1;
+            argv = DefaultArgs;
+        }
+
+        OutputFile = stdout;
+        PrgName = argv[0];
+
+        if (!ReadSettings(argc, argv))
+            return (FALSE);
+
+        FinishSettings();
+        Initialized = TRUE;
+    }
+
+    return (TRUE);
+}
+
+int ChkTeXCheckBuffer(const char *Name, const char *Data, size_t Len,
+                      ChkTeXReport Report, void *UserData)
+{
+    struct CheckState *cs;
+    int Found = -1;
+
+    if (Initialized && Report && (Data || !Len) &&
+        (cs = NewCheckState(NULL)))
+    {
+        cs->StatusFile = NULL;
+        cs->Report = Report;
+        cs->ReportData = UserData;
+
+        if (PushBuffer(Name ? Name : "stdin", Data ? Data : "",
+                       (unsigned long) Len, &cs->InputStack))
+        {
+            CheckInput(cs);
+            Found = (int) (cs->ErrPrint + cs->WarnPrint);
+        }
+
+        FreeCheckState(cs);
+    }
+
+    return (Found);
+}
+
+struct ChkTeXSession *ChkTeXNewSession(void)
+{
+    return (Initialized ? NewSession() : NULL);
+}
+
+int ChkTeXRecheck(struct ChkTeXSession *Session, const char *Name,
+                  const char *Data, size_t Len, ChkTeXReport Report,
+                  void *UserData)
+{
+    if (!Initialized || !Session || !Report || (!Data && Len))
+        return (-1);
+
+    return (Recheck(Session, Name ? Name : "stdin", Data ? Data : "",
+                    (unsigned long) Len, Report, UserData));
+}
+
+void ChkTeXFreeSession(struct ChkTeXSession *Session)
+{
+    FreeSession(Session);
+}
@@ -0,0 +1,120 @@
+/*
+ *  ChkTeX, library interface.
+ *  Copyright (C) 1995-96 Jens T. Berger Thielemann
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Contact the author at:
+ *              Jens Berger
+ *              Spektrumvn. 4
+ *              N-0666 Oslo
+ *              Norway
+ *              E-mail: <jensthi@ifi.uio.no>
+ *
+ *
+ */
+
+#ifndef CHKTEXLIB_H
+#define CHKTEXLIB_H
+
+/*
+ * ChkTeX as a library, for programs (editors, mostly) which wish to
+ * check documents without running chktex and parsing its output.
+ *
+ * Call ChkTeXInit() once, and then ChkTeXCheckBuffer() as often as
+ * you like; the configuration is only read once. Checking does not
+ * change the configuration, so ChkTeXCheckBuffer() may be called from
+ * several threads at the same time.
+ *
+ * Like chktex itself, we still give up (exit) if we run out of memory
+ * or the options are faulty (e.g. -w999 or an unknown option), and
+ * program messages (e.g. about \input files we couldn't find) still go
+ * to stderr.
+ */
+
+#include <stddef.h>
+
+enum ChkTeXKind
+{
+    ckMessage,
+    ckWarning,
+    ckError
+};
+
+/*
+ * A single warning, error or message found in a document. The strings
+ * are only valid during the call to the ChkTeXReport function.
+ */
+
+struct ChkTeXDiag
+{
+    const char *File;           /* File it was found in */
+    unsigned long Line;         /* Line number, counting from 1 */
+    long Column;                /* Column, counting from 1; tabs are
+                                 * expanded, as in chktex's output */
+    long Length;                /* # of characters marked; may be 0 */
+    int Number;                 /* Message number, as used by -w, -n... */
+    enum ChkTeXKind Kind;
+    const char *Message;        /* The message, without any position */
+};
+
+typedef void (*ChkTeXReport) (const struct ChkTeXDiag *Diag, void *UserData);
+
+/*
+ * Reads the resource files and the options in `argv', exactly as
+ * chktex would for the same command line (`argv[0]' being the program
+ * name); any file names are ignored. Faulty options make us exit, as
+ * above. Returns 0 if the options only asked for help (-h), which is
+ * then printed on stderr, non-zero otherwise.
+ *
+ * Only the first successful call reads anything; later ones keep that
+ * configuration, ignore `argv' and just return non-zero.
+ */
+
+int ChkTeXInit(int argc, char **argv);
+
+/*
+ * Checks the `Len' bytes at `Data' as a document called `Name' (which
+ * is only used in the reports). `Report' is called with `UserData' for
+ * every warning, error or message, in the order chktex would print
+ * them. `Data' may only be NULL if `Len' is 0. Returns the number of
+ * errors and warnings found, or -1 if we couldn't check the document at
+ * all.
+ */
+
+int ChkTeXCheckBuffer(const char *Name, const char *Data, size_t Len,
+                      ChkTeXReport Report, void *UserData);
+
+/*
+ * For documents which are checked over and over while being edited.
+ * A session remembers the last version of the document it checked
+ * and how checking it went, so ChkTeXRecheck() only has to look at
+ * the part of the document which changed (and as much after it as
+ * the change affects). It reports and returns exactly what
+ * ChkTeXCheckBuffer() would. Documents which \input other files are
+ * always checked in full.
+ *
+ * A session may only be used by one thread at a time.
+ */
+
+struct ChkTeXSession;
+
+struct ChkTeXSession *ChkTeXNewSession(void);
+int ChkTeXRecheck(struct ChkTeXSession *Session, const char *Name,
+                  const char *Data, size_t Len, ChkTeXReport Report,
+                  void *UserData);
+void ChkTeXFreeSession(struct ChkTeXSession *Session);
+
+#endif /* CHKTEXLIB_H */
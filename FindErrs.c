@@ -32,28 +32,69 @@
 #include "OpSys.h"
 #include "Utility.h"
 #include "Resource.h"
+#include "Cache.h"
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#  include <emmintrin.h>
+#  define USE_SSE2 1
+#else
+#  define USE_SSE2 0
+#endif
 
 #if HAVE_PCRE || HAVE_POSIX_ERE
 
-#if HAVE_PCRE
+#if HAVE_PCRE2
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#elif HAVE_PCRE
 #include <pcreposix.h>
 #else
 #include <regex.h>
 #endif
 
 #define REGEX_FLAGS REG_EXTENDED
-#define NUM_MATCHES 10
 #define ERROR_STRING_SIZE 100
 
-regex_t* RegexArray = NULL;
-regex_t* SilentRegex = NULL;
+/* A compiled pattern; see CompileRegex() */
+struct Regex
+{
+#if HAVE_PCRE2
+    pcre2_code *Code;
+#else
+    regex_t Posix;
+#endif
+};
+
+struct Regex* RegexArray = NULL;
+struct Regex* SilentRegex = NULL;
 int NumRegexes = 0;
 
+/* Alternations of UserWarnRegex patterns; see SetupRegexGroup() */
+struct Regex* RegexGroups = NULL;
+char* GroupOk = NULL;
+
+/* What each UserWarnRegex pattern needs to match; see SetupLiterals() */
+char** RegexLiterals = NULL;
+unsigned long* LiteralRegex = NULL;
+struct Matcher Literals;
+
+/* How well that works, for -d16; see ShowRegexStats() */
+struct RegexStat
+{
+    unsigned long Passed;       /* Lines which had the literal */
+    unsigned long Matched;      /* Lines which the pattern matched */
+};
+
+struct RegexStat* RegexTotals = NULL;
+unsigned long RegexLines = 0;
+#if USE_THREADS
+static pthread_mutex_t RegexStatLock = PTHREAD_MUTEX_INITIALIZER;
 #endif
 
-int FoundErr = EXIT_SUCCESS;
-int LastWasComment = FALSE;
-int SeenSpace = FALSE;
+static int ExecRegex(struct CheckState *cs, struct Regex *re,
+                     const char *Str, long *Start, long *End, char *Error);
+
+#endif
 
 /***************************** ERROR MESSAGES ***************************/
 
@@ -64,25 +105,25 @@ struct ErrMsg LaTeXMsgs[emMaxFault + 1] = {
     ERRMSGS {emMaxFault, etErr, iuOK, 0, INTERNFAULT}
 };
 
-#define istex(c)        (isalpha((unsigned char)c) || (AtLetter && (c == '@')))
+#define istex(c)        (isalpha((unsigned char)c) || (cs->AtLetter && (c == '@')))
 #define CTYPE(func) \
 static int my_##func(int c) \
 { \
    return(func(c)); \
 }
 
-#define SUPPRESSED_ON_LINE(c)  (LineSuppressions & ((uint64_t)1<<c))
+#define SUPPRESSED_ON_LINE(c)  (cs->LineSuppressions & ((uint64_t)1<<c))
 
 #define INUSE(c) \
     ((LaTeXMsgs[(enum ErrNum) c].InUse == iuOK) && !SUPPRESSED_ON_LINE(c))
 
 #define PSERR2(pos,len,err,a,b) \
-    PrintError(CurStkName(&InputStack), RealBuf, pos, len, Line, err, a, b)
+    PrintError(cs, CurStkName(cs), cs->RealBuf, pos, len, cs->Line, err, a, b)
 
 #define PSERRA(pos,len,err,a) \
-    PrintError(CurStkName(&InputStack), RealBuf, pos, len, Line, err, a)
+    PrintError(cs, CurStkName(cs), cs->RealBuf, pos, len, cs->Line, err, a)
 
-#define HEREA(len, err, a)     PSERRA(BufPtr - Buf - 1, len, err, a)
+#define HEREA(len, err, a)     PSERRA(cs->BufPtr - cs->Buf - 1, len, err, a)
 #define PSERR(pos,len,err)     PSERRA(pos,len,err,"")
 
 #define HERE(len, err)         HEREA(len, err, "")
@@ -123,13 +164,18 @@ static const char LTX_GenPunc[] = { ',', ';', 0 };
  */
 static const char LTX_SmallPunc[] = { '.', ',', 0 };
 
+/*
+ * The start of both suppression delimiters below.
+ */
+#define SUPP_DELIM "chktex"
+
 /*
  * String used to delimit a line suppression.  This string must be
  * followed immediately by the number of the warning to be suppressed.
  * If more than one warning is to be suppressed, then multiple copies
  * of LineSuppDelim+number must be used.
  */
-const char LineSuppDelim[] = "chktex ";
+const char LineSuppDelim[] = SUPP_DELIM " ";
 
 /*
  * String used to delimit a file suppression.  This string must be
@@ -137,31 +183,76 @@ const char LineSuppDelim[] = "chktex ";
  * If more than one warning is to be suppressed, then multiple copies
  * of FileSuppDelim+number must be used.
  */
-const char FileSuppDelim[] = "chktex-file ";
+const char FileSuppDelim[] = SUPP_DELIM "-file ";
 
 /*
- * A bit field used to hold the suppressions for the current line.
- */
-static uint64_t LineSuppressions;
-/*
- * A bit field used to hold the suppressions of numbered user warnings
- * for the current line.
+ * What we know about each command: which of the lists it is in, and
+ * whether we handle it ourselves. SetupCommands() collects it all in
+ * one table, so that a single lookup tells us everything.
  */
-static uint64_t UserLineSuppressions;
 
-static unsigned long Line;
+#define CMDBITS(name) enum name { \
+  BIT(Linker),       /* Wants a ~ in front */ \
+  BIT(PostLink),     /* Doesn't want a ~ in front */ \
+  BIT(Silent),       /* May be terminated with a space */ \
+  BIT(IJAccent),     /* Accent which shouldn't go on i or j */ \
+  BIT(NotPreSpaced), /* Mustn't have space in front */ \
+  BIT(MathCmd),      /* Argument is in math mode */ \
+  BIT(TextCmd),      /* Argument is in text mode */ \
+  BIT(Primitives),   /* TeX primitive */ \
+  BIT(NonItalic),    /* Turns italics off */ \
+  BIT(Italic),       /* Turns italics on */ \
+  BIT(ItalCmd)       /* Argument is in italics */ \
+}
+
+#undef BIT
+#define BIT BITDEF1
+CMDBITS(Cmd_BIT);
+#undef BIT
+#define BIT BITDEF2
+CMDBITS(CmdFlags);
+
+/* Commands we handle ourselves */
+enum Builtin
+{
+    biNone,
+    biVerb,
+    biBegin,
+    biEnd,
+    biInput,
+    biInclude,
+    biMakeAtLetter,
+    biMakeAtOther,
+    biCDots,
+    biLDots,
+    biDots
+};
+
+struct Command
+{
+    int Flags;                  /* FLG_ bits from CMDBITS */
+    enum Builtin Builtin;
+    const char *WipeArg;        /* Its entry in WipeArg, or NULL */
+    const char *NoCharNext;     /* Its entry in NoCharNext, or NULL */
+};
+
+static struct Hash Commands;    /* Each slot's Data is a struct Command */
+static const struct Command NoCommand = { 0, biNone, NULL, NULL };
 
-static const char *RealBuf;
-static char *BufPtr;
+static struct Trie Abbrevs;     /* Abbrev, reversed; see SetupAbbrevs() */
 
-static int ItFlag = efNone;
-static int MathFlag = efNone;
+/* CenterDots and LowDots, reversed for what goes before; see SetupDots() */
+static struct Trie CDotsBefore, CDotsAfter, LDotsBefore, LDotsAfter;
 
-NEWBUF(Buf, BUFSIZ);
-NEWBUF(CmdBuffer, BUFSIZ);
-NEWBUF(ArgBuffer, BUFSIZ);
+static struct Matcher DashExcpts;       /* See SetupDots() */
 
-static enum ErrNum PerformCommand(const char *Cmd, char *Arg);
+/* Which bytes FindErr() has to look at; see SetupPlain() */
+#define PLAIN_TEXT      0x01    /* Does something outside maths */
+#define PLAIN_MATH      0x02    /* ...or in maths */
+static unsigned char PlainClass[256];
+
+static enum ErrNum PerformCommand(struct CheckState *cs, const char *Cmd,
+                                  const struct Command *Info, char *Arg);
 
 #ifdef isdigit
 CTYPE(isdigit)
@@ -181,7 +272,7 @@ CTYPE(isalpha)
  */
 
 
-static char *GetLTXToken(char *Src, char *Dest)
+static char *GetLTXToken(struct CheckState *cs, char *Src, char *Dest)
 {
     int Char;
 
@@ -234,8 +325,8 @@ static char *GetLTXToken(char *Src, char *Dest)
 #define GET_TOKEN       256
 #define GET_STRIP_TOKEN 257
 
-static char *GetLTXArg(char *SrcBuf, char *OrigDest, const int Until,
-	struct WordList *wl)
+static char *GetLTXArg(struct CheckState *cs, char *SrcBuf, char *OrigDest,
+                       const int Until, struct WordList *wl)
 {
     char *Retval;
     char *TmpPtr;
@@ -249,7 +340,7 @@ static char *GetLTXArg(char *SrcBuf, char *OrigDest, const int Until,
     {
     case GET_STRIP_TOKEN:
     case GET_TOKEN:
-        while ((Retval = GetLTXToken(TmpPtr, Dest)))
+        while ((Retval = GetLTXToken(cs, TmpPtr, Dest)))
         {
             switch (*Dest)
             {
@@ -268,7 +359,7 @@ static char *GetLTXArg(char *SrcBuf, char *OrigDest, const int Until,
 
         if (Retval && (*OrigDest == '{') && (Until == GET_STRIP_TOKEN))
         {
-            int len = strlen(OrigDest+1);
+            int len = Dest - OrigDest - 1;
             memmove(OrigDest, OrigDest + 1, len  + 1);
             /* Strip the last '}' off */
             OrigDest[len-1] = 0;
@@ -276,7 +367,7 @@ static char *GetLTXArg(char *SrcBuf, char *OrigDest, const int Until,
         break;
     default:
         DeliCnt = TRUE;
-        while ((Retval = GetLTXArg(TmpPtr, Dest, GET_TOKEN, NULL)))
+        while ((Retval = GetLTXArg(cs, TmpPtr, Dest, GET_TOKEN, NULL)))
         {
             if (*Dest == Until)
                 DeliCnt = FALSE;
@@ -294,165 +385,330 @@ static char *GetLTXArg(char *SrcBuf, char *OrigDest, const int Until,
     return (Retval);
 }
 
-static char *PreProcess(void)
+/*
+ * How many bytes at the start of `Src' (`Len' bytes) PreProcess() can
+ * copy as they are. Where SSE2 is available, 16 are looked at at a
+ * time.
+ */
+
+#define PREPROCESS_PLAIN(c) \
+    ((c) && ((c) != '\t') && ((c) != '\n') && ((c) != '\r') && \
+     ((c) != '%') && ((c) != '\\'))
+
+static unsigned long PlainRun(const char *Src, unsigned long Len)
+{
+    unsigned long Run = 0;
+
+#if USE_SSE2
+    __m128i Text, Special;
+    unsigned int Bits;
+
+    for (; Run + 16 <= Len; Run += 16)
+    {
+        Text = _mm_loadu_si128((const __m128i *) &Src[Run]);
+        Special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(Text, _mm_setzero_si128()),
+                         _mm_cmpeq_epi8(Text, _mm_set1_epi8('\t'))),
+            _mm_or_si128(_mm_cmpeq_epi8(Text, _mm_set1_epi8('\n')),
+                         _mm_cmpeq_epi8(Text, _mm_set1_epi8('\r'))));
+        Special = _mm_or_si128(Special,
+            _mm_or_si128(_mm_cmpeq_epi8(Text, _mm_set1_epi8('%')),
+                         _mm_cmpeq_epi8(Text, _mm_set1_epi8('\\'))));
+
+        if ((Bits = (unsigned int) _mm_movemask_epi8(Special)))
+            return (Run + __builtin_ctz(Bits));
+    }
+#endif
+
+    while ((Run < Len) && PREPROCESS_PLAIN(Src[Run]))
+        Run++;
+    return (Run);
+}
+
+/*
+ * The length of `Prefix' (in lower case) if `Str' starts with it,
+ * regardless of case; 0 if not.
+ */
+
+static unsigned long PrefixNoCase(const char *Str, const char *Prefix)
 {
-    char *TmpPtr;
+    unsigned long i;
 
-    /* Reset any line suppressions  */
+    for (i = 0; Prefix[i]; i++)
+    {
+        if (tolower((unsigned char) Str[i]) != Prefix[i])
+            return (0);
+    }
+    return (i);
+}
 
-    LineSuppressions = FileSuppressions;
-    UserLineSuppressions = UserFileSuppressions;
+/*
+ * Reads the suppressions in the comment `Text', in any case: each
+ * FileSuppDelim or LineSuppDelim followed by the number of a warning.
+ * Both start with SUPP_DELIM, so one search for its first letter, in
+ * either case, finds them all.
+ */
 
-    /* Kill comments. */
-    strcpy(Buf, RealBuf);
+static void CommentSuppressions(struct CheckState *cs, const char *Text)
+{
+    const int MaxSuppressionBits = 63;
+    unsigned long Len;
+    int error, File;
+    char First[3];
 
-    TmpPtr = Buf;
+    First[0] = tolower((unsigned char) FileSuppDelim[0]);
+    First[1] = toupper((unsigned char) FileSuppDelim[0]);
+    First[2] = 0;
 
-    LastWasComment = FALSE;
-    while ((TmpPtr = strchr(TmpPtr, '%')))
+    while ((Text = strpbrk(Text, First)))
     {
-        char *EscapePtr = TmpPtr;
-        int NumBackSlashes = 0;
-        while (EscapePtr != Buf && EscapePtr[-1] == '\\')
+        if ((Len = PrefixNoCase(Text, FileSuppDelim)))
+            File = TRUE;
+        else if ((Len = PrefixNoCase(Text, LineSuppDelim)))
+            File = FALSE;
+        else
         {
-            ++NumBackSlashes;
-            --EscapePtr;
+            Text++;
+            continue;
         }
 
-        /* If there is an even number of backslashes, then it's a comment. */
-        if ((NumBackSlashes % 2) == 0)
+        Text += Len;
+        error = atoi(Text);
+
+        if (abs(error) > MaxSuppressionBits)
         {
-            LastWasComment = TRUE;
-            PSERR(TmpPtr - Buf, 1, emComment);
-            *TmpPtr = 0;
-            /* Check for line suppressions */
-            if (!NoLineSupp)
-            {
-                int error;
-                const int MaxSuppressionBits = 63;
+            PrintPrgErr(pmSuppTooHigh, error, MaxSuppressionBits);
+            continue;
+        }
 
-                /* Convert to lowercase to compare with LineSuppDelim */
-                EscapePtr = ++TmpPtr; /* move past NUL terminator */
-                while ( *EscapePtr )
-                {
-                    *EscapePtr = tolower((unsigned char)*EscapePtr);
-                    ++EscapePtr;
-                }
+        if (error > 0)
+        {
+            if (File)
+                cs->FileSuppressions |= ((uint64_t)1 << error);
+            cs->LineSuppressions |= ((uint64_t)1 << error);
+        }
+        else
+        {
+            if (File)
+                cs->UserFileSuppressions |= ((uint64_t)1 << (-error));
+            cs->UserLineSuppressions |= ((uint64_t)1 << (-error));
+        }
+    }
+}
 
-                EscapePtr = TmpPtr; /* Save it for later */
-                while ((TmpPtr = strstr(TmpPtr, FileSuppDelim))) {
-                    TmpPtr += STRLEN(FileSuppDelim);
-                    error = atoi(TmpPtr);
+/*
+ * Prepares a raw line for checking, in a single pass. RealBuf (which
+ * is what we show the user) gets newlines and carriage returns turned
+ * into spaces, tabs expanded and a space appended. Buf (which is what
+ * we check) is the same, except that the first unescaped `%' becomes
+ * a NUL.
+ */
 
-                    if (abs(error) > MaxSuppressionBits)
-                    {
-                        PrintPrgErr(pmSuppTooHigh, error, MaxSuppressionBits);
-                    }
-                    if (error > 0)
-                    {
-                        FileSuppressions |= ((uint64_t)1 << error);
-                        LineSuppressions |= ((uint64_t)1 << error);
-                    }
-                    else
-                    {
-                        UserFileSuppressions |= ((uint64_t)1 << (-error));
-                        UserLineSuppressions |= ((uint64_t)1 << (-error));
-                    }
-                }
-                TmpPtr = EscapePtr;
+static char *PreProcess(struct CheckState *cs, const char *Src,
+                        unsigned long Len)
+{
+    unsigned long i, Run, Col = 0, Comment = 0, Slashes = 0;
+    unsigned long Tab = max(TabWidth, 1);
+    int c, InComment = FALSE;
 
-                while ((TmpPtr = strstr(TmpPtr, LineSuppDelim))) {
+    /* Reset any line suppressions  */
 
-                    TmpPtr += STRLEN(LineSuppDelim);
-                    error = atoi(TmpPtr);
+    cs->LineSuppressions = cs->FileSuppressions;
+    cs->UserLineSuppressions = cs->UserFileSuppressions;
 
-                    if (abs(error) > MaxSuppressionBits)
-                    {
-                        PrintPrgErr(pmSuppTooHigh, error, MaxSuppressionBits);
-                    }
+    GROWBUF(cs->RealBuf, Len + 2);
+    GROWBUF(cs->Buf, Len + 2);
 
-                    if (error > 0)
-                    {
-                        LineSuppressions |= ((uint64_t)1 << error);
-                    }
-                    else
-                    {
-                        UserLineSuppressions |= ((uint64_t)1 << (-error));
-                    }
-                }
+    for (i = 0; i < Len; i++)
+    {
+        /* Most of the line is copied in one go */
+        if ((Run = PlainRun(&Src[i], Len - i)))
+        {
+            memcpy(&cs->RealBuf[Col], &Src[i], Run);
+            memcpy(&cs->Buf[Col], &Src[i], Run);
+            Col += Run;
+            Slashes = 0;
+            if ((i += Run) >= Len)
+                break;
+        }
+
+        if (!(c = (unsigned char) Src[i]))
+            break;
+
+        switch (c)
+        {
+        case '\t':
+            c = Tab - (Col % Tab);
+            GROWBUF(cs->RealBuf, Col + c + (Len - i) + 1);
+            GROWBUF(cs->Buf, Col + c + (Len - i) + 1);
+            memset(&cs->RealBuf[Col], ' ', c);
+            memset(&cs->Buf[Col], ' ', c);
+            Col += c;
+            Slashes = 0;
+            continue;
+        case '\n':
+        case '\r':
+            c = ' ';
+            break;
+        case '%':
+            /* If there is an even number of backslashes, then it's a comment. */
+            if (!InComment && !(Slashes & 1))
+            {
+                InComment = TRUE;
+                Comment = Col;
+                cs->RealBuf[Col] = '%';
+                cs->Buf[Col++] = 0;
+                continue;
             }
             break;
         }
-        TmpPtr++;
+
+        Slashes = (c == '\\') ? Slashes + 1 : 0;
+        cs->RealBuf[Col] = c;
+        cs->Buf[Col++] = c;
+    }
+
+    cs->RealBuf[Col] = ' ';
+    cs->Buf[Col++] = ' ';
+    cs->RealBuf[Col] = cs->Buf[Col] = 0;
+
+    cs->LastWasComment = InComment;
+    if (InComment)
+    {
+        PSERR(Comment, 1, emComment);
+        /* Check for line suppressions */
+        if (!NoLineSupp)
+            CommentSuppressions(cs, &cs->RealBuf[Comment + 1]);
     }
-    return (Buf);
+    return (cs->Buf);
 }
 
 /*
  * Interpret environments
  */
 
-static void PerformEnv(char *Env, int Begin)
+static void PerformEnv(struct CheckState *cs, char *Env, int Begin)
 {
-    static char VBStr[BUFSIZ] = "";
-
     if (HasWord(Env, &MathEnvir))
     {
-        MathMode += Begin ? 1 : -1;
-        MathMode = max(MathMode, 0);
+        cs->MathMode += Begin ? 1 : -1;
+        cs->MathMode = max(cs->MathMode, 0);
     }
 
     if (Begin && HasWord(Env, &VerbEnvir))
     {
-        VerbMode = TRUE;
-        strcpy(VBStr, "\\end{");
-        strcat(VBStr, Env);
-        strcat(VBStr, "}");
-        VerbStr = VBStr;
+        cs->VerbMode = TRUE;
+        GROWBUF(cs->VBStr, strlen(Env) + 7);
+        strcpy(cs->VBStr, "\\end{");
+        strcat(cs->VBStr, Env);
+        strcat(cs->VBStr, "}");
+        cs->VerbStr = cs->VBStr;
     }
 }
 
-static char *SkipVerb(void)
+static char *SkipVerb(struct CheckState *cs)
 {
-    char *TmpPtr = BufPtr;
+    char *TmpPtr = cs->BufPtr;
     int TmpC;
 
-    if (VerbMode && BufPtr)
+    if (cs->VerbMode && cs->BufPtr)
     {
-        if (!(TmpPtr = strstr(BufPtr, VerbStr)))
-            BufPtr = &BufPtr[strlen(BufPtr)];
+        if (!(TmpPtr = strstr(cs->BufPtr, cs->VerbStr)))
+            cs->BufPtr = &cs->BufPtr[strlen(cs->BufPtr)];
         else
         {
-            VerbMode = FALSE;
-            BufPtr = &TmpPtr[strlen(VerbStr)];
-            SKIP_AHEAD(BufPtr, TmpC, LATEX_SPACE(TmpC));
-            if (*BufPtr)
-                PSERR(BufPtr - Buf, strlen(BufPtr) - 2, emIgnoreText);
+            cs->VerbMode = FALSE;
+            cs->BufPtr = &TmpPtr[strlen(cs->VerbStr)];
+            SKIP_AHEAD(cs->BufPtr, TmpC, LATEX_SPACE(TmpC));
+            if (*cs->BufPtr)
+                PSERR(cs->BufPtr - cs->Buf, strlen(cs->BufPtr) - 2, emIgnoreText);
         }
     }
     return (TmpPtr);
 }
 
-#define CHECKDOTS(wordlist, dtval) \
-for(i = 0; (i < wordlist.Stack.Used) && !(Back && Front);  i++) \
- { if(!strafter(PstPtr, wordlist.Stack.Data[i])) \
-         Back = dtval; \
-   if(!strinfront(PrePtr, wordlist.Stack.Data[i])) \
-         Front = dtval; }
+/*
+ * Skips the bytes from `Ptr' which FindErr() has nothing to do with,
+ * given `Mask' (PLAIN_TEXT or PLAIN_MATH); `End' is the end of the
+ * line. Where SSE2 is available, runs of letters and digits are
+ * taken 16 at a time.
+ */
+
+static char *SkipPlain(char *Ptr, const char *End, int Mask)
+{
+#if USE_SSE2
+    const __m128i LetterOff = _mm_set1_epi8((char) (0x80 - 'a'));
+    const __m128i LetterMax = _mm_set1_epi8((char) (0x80 + 26));
+    const __m128i DigitOff = _mm_set1_epi8((char) (0x80 - '0'));
+    const __m128i DigitMax = _mm_set1_epi8((char) (0x80 + 10));
+    const __m128i Case = _mm_set1_epi8(0x20), Times = _mm_set1_epi8('x');
+    __m128i Text, Lower, Plain;
+    unsigned int Bits;
+
+    /* Letters are only plain outside maths, and x never is */
+    while ((Mask == PLAIN_TEXT) && (Ptr + 16 <= End))
+    {
+        Text = _mm_loadu_si128((const __m128i *) Ptr);
+        Lower = _mm_or_si128(Text, Case);
+        Plain = _mm_andnot_si128(_mm_cmpeq_epi8(Lower, Times),
+                                 _mm_cmplt_epi8(_mm_add_epi8(Lower, LetterOff),
+                                                LetterMax));
+        Plain = _mm_or_si128(Plain,
+                             _mm_cmplt_epi8(_mm_add_epi8(Text, DigitOff),
+                                            DigitMax));
+
+        if ((Bits = ~(unsigned int) _mm_movemask_epi8(Plain) & 0xffff))
+        {
+            Ptr += __builtin_ctz(Bits);
+            break;
+        }
+        Ptr += 16;
+    }
+#else
+    (void) End;
+#endif
+
+    while (!(PlainClass[(unsigned char) *Ptr] & Mask))
+        Ptr++;
+    return (Ptr);
+}
+
+/*
+ * Builds the table SkipPlain() uses. Anything which has a case in
+ * FindErr() has to be in it, as have letters in maths (MathRoman)
+ * and whatever sets SeenSpace. Call this once after the configuration
+ * has been read, before checking anything.
+ */
 
+void SetupPlain(void)
+{
+    static const char Special[] = "~xX.:?!;,'`\"\264_^-\\(){}[]$";
+    const char *Ptr;
+    int c;
 
+    for (c = 0; c < 256; c++)
+    {
+        PlainClass[c] = 0;
+        if (LATEX_SPACE(c) || isspace(c) || !c)
+            PlainClass[c] = PLAIN_TEXT | PLAIN_MATH;
+        else if (((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')))
+            PlainClass[c] = PLAIN_MATH;
+    }
+    for (Ptr = Special; *Ptr; Ptr++)
+        PlainClass[(unsigned char) *Ptr] = PLAIN_TEXT | PLAIN_MATH;
+}
 
 /*
- * Checks that the dots are correct
+ * Checks that the dots are correct: both sides have to be in
+ * CenterDots, or both in LowDots.
  */
 
-static enum DotLevel CheckDots(char *PrePtr, char *PstPtr)
+static enum DotLevel CheckDots(struct CheckState *cs, char *PrePtr,
+                               char *PstPtr)
 {
-    unsigned long i;
     int TmpC;
-    enum DotLevel Front = dtUnknown, Back = dtUnknown;
 
-    if (MathMode)
+    if (cs->MathMode)
     {
         PrePtr--;
 #define SKIP_EMPTIES(macro, ptr) macro(ptr, TmpC, \
@@ -461,13 +717,13 @@ static enum DotLevel CheckDots(char *PrePtr, char *PstPtr)
         SKIP_EMPTIES(SKIP_BACK, PrePtr);
         SKIP_EMPTIES(SKIP_AHEAD, PstPtr);
 
-        CHECKDOTS(CenterDots, dtCDots);
-
-        if (!(Front && Back))
-        {
-            CHECKDOTS(LowDots, dtLDots);
-        }
-        return (Front & Back);
+        if (TrieMatch(&CDotsBefore, PrePtr, TRUE) &&
+            TrieMatch(&CDotsAfter, PstPtr, FALSE))
+            return (dtCDots);
+        if (TrieMatch(&LDotsBefore, PrePtr, TRUE) &&
+            TrieMatch(&LDotsAfter, PstPtr, FALSE))
+            return (dtLDots);
+        return (dtUnknown);
     }
     else
         return (dtLDots);
@@ -499,7 +755,7 @@ static const char *Dot2Str(enum DotLevel dl)
  * Wipes a command, according to the definition in WIPEARG
  */
 
-static void WipeArgument(const char *Cmd, char *CmdPtr)
+static void WipeArgument(struct CheckState *cs, const char *Cmd, char *CmdPtr)
 {
     unsigned long CmdLen = strlen(Cmd);
     const char *Format;
@@ -523,16 +779,16 @@ static void WipeArgument(const char *Cmd, char *CmdPtr)
             case '[':
                 SKIP_AHEAD(TmpPtr, TmpC, LATEX_SPACE(TmpC));
                 if (*TmpPtr == '[')
-                    TmpPtr = GetLTXArg(TmpPtr, ArgBuffer, ']', NULL);
+                    TmpPtr = GetLTXArg(cs, TmpPtr, cs->ArgBuffer, ']', NULL);
                 break;
             case '(':
                 SKIP_AHEAD(TmpPtr, TmpC, LATEX_SPACE(TmpC));
                 if (*TmpPtr == '(')
-                    TmpPtr = GetLTXArg(TmpPtr, ArgBuffer, ')', NULL);
+                    TmpPtr = GetLTXArg(cs, TmpPtr, cs->ArgBuffer, ')', NULL);
                 break;
             case '{':
                 SKIP_AHEAD(TmpPtr, TmpC, LATEX_SPACE(TmpC));
-                TmpPtr = GetLTXArg(TmpPtr, ArgBuffer, GET_TOKEN, NULL);
+                TmpPtr = GetLTXArg(cs, TmpPtr, cs->ArgBuffer, GET_TOKEN, NULL);
             case '}':
             case ']':
             case ')':
@@ -555,22 +811,22 @@ static void WipeArgument(const char *Cmd, char *CmdPtr)
  *
  */
 
-static void CheckItal(const char *Cmd)
+static void CheckItal(struct CheckState *cs, const struct Command *Info)
 {
     int TmpC;
     char *TmpPtr;
-    if (HasWord(Cmd, &NonItalic))
-        ItState = itOff;
-    else if (HasWord(Cmd, &Italic))
-        ItState = itOn;
-    else if (HasWord(Cmd, &ItalCmd))
+    if (Info->Flags & FLG_NonItalic)
+        cs->ItState = itOff;
+    else if (Info->Flags & FLG_Italic)
+        cs->ItState = itOn;
+    else if (Info->Flags & FLG_ItalCmd)
     {
-        TmpPtr = BufPtr;
+        TmpPtr = cs->BufPtr;
         SKIP_AHEAD(TmpPtr, TmpC, LATEX_SPACE(TmpC));
         if (*TmpPtr == '{')
         {
-            ItFlag = ItState ? efItal : efNoItal;
-            ItState = itOn;
+            cs->ItFlag = cs->ItState ? efItal : efNoItal;
+            cs->ItState = itOn;
         }
     }
 }
@@ -580,145 +836,149 @@ static void CheckItal(const char *Cmd)
  *
  */
 
-static void PerformBigCmd(char *CmdPtr)
+static void PerformBigCmd(struct CheckState *cs, char *CmdPtr,
+                          const struct Command *Info)
 {
     char *TmpPtr;
     const char *ArgEndPtr;
-    unsigned long CmdLen = strlen(CmdBuffer);
+    unsigned long CmdLen = strlen(cs->CmdBuffer);
     int TmpC;
     enum ErrNum ErrNum;
     struct ErrInfo *ei;
 
     enum DotLevel dotlev, realdl = dtUnknown;
 
-    TmpPtr = BufPtr;
+    TmpPtr = cs->BufPtr;
     SKIP_AHEAD(TmpPtr, TmpC, LATEX_SPACE(TmpC));
 
-    ArgEndPtr = GetLTXArg(TmpPtr, ArgBuffer, GET_STRIP_TOKEN, NULL);
+    ArgEndPtr = GetLTXArg(cs, TmpPtr, cs->ArgBuffer, GET_STRIP_TOKEN, NULL);
 
     /* Kill `\verb' commands */
 
     if (WipeVerb)
     {
-        if (!strcmp(CmdBuffer, "\\verb"))
+        if (Info->Builtin == biVerb)
         {
-            if (*BufPtr && (*BufPtr != '*' || BufPtr[1]))
+            if (*cs->BufPtr && (*cs->BufPtr != '*' || cs->BufPtr[1]))
             {
-                if (*BufPtr == '*')
-                    TmpPtr = strchr(&BufPtr[2], BufPtr[1]);
+                if (*cs->BufPtr == '*')
+                    TmpPtr = strchr(&cs->BufPtr[2], cs->BufPtr[1]);
                 else
-                    TmpPtr = strchr(&BufPtr[1], *BufPtr);
+                    TmpPtr = strchr(&cs->BufPtr[1], *cs->BufPtr);
                 if (TmpPtr)
                     strwrite(CmdPtr, VerbClear, (TmpPtr - CmdPtr) + 1);
                 else
-                    PSERR(CmdPtr - Buf, 5, emNoArgFound);
+                    PSERR(CmdPtr - cs->Buf, 5, emNoArgFound);
             }
         }
     }
 
-    if (HasWord(CmdBuffer, &IJAccent))
+    if (Info->Flags & FLG_IJAccent)
     {
         if (ArgEndPtr)
         {
-            TmpPtr = ArgBuffer;
+            TmpPtr = cs->ArgBuffer;
             SKIP_AHEAD(TmpPtr, TmpC, TmpC == '{');      /* } */
 
             if ((*TmpPtr == 'i') || (*TmpPtr == 'j'))
-                PrintError(CurStkName(&InputStack), RealBuf,
-                           CmdPtr - Buf,
-                           (long) strlen(CmdBuffer), Line,
-                           emAccent, CmdBuffer, *TmpPtr,
-                           MathMode ? "math" : "");
+                PrintError(cs, CurStkName(cs), cs->RealBuf,
+                           CmdPtr - cs->Buf,
+                           (long) strlen(cs->CmdBuffer), cs->Line,
+                           emAccent, cs->CmdBuffer, *TmpPtr,
+                           cs->MathMode ? "math" : "");
         }
         else
-            PSERR(CmdPtr - Buf, CmdLen, emNoArgFound);
+            PSERR(CmdPtr - cs->Buf, CmdLen, emNoArgFound);
     }
 
-    if (HasWord(CmdBuffer, &NotPreSpaced) && isspace((unsigned char)CmdPtr[-1]))
-        PSERRA(CmdPtr - Buf - 1, 1, emRemPSSpace, CmdBuffer);
+    if ((Info->Flags & FLG_NotPreSpaced) && isspace((unsigned char)CmdPtr[-1]))
+        PSERRA(CmdPtr - cs->Buf - 1, 1, emRemPSSpace, cs->CmdBuffer);
 
-    if ((TmpPtr = HasWord(CmdBuffer, &NoCharNext)))
+    if (Info->NoCharNext)
     {
-        char *BPtr = BufPtr;
+        char *BPtr = cs->BufPtr;
+        const char *Chars = Info->NoCharNext;
 
-        TmpPtr += strlen(TmpPtr) + 1;
+        Chars += strlen(Chars) + 1;
         SKIP_AHEAD(BPtr, TmpC, LATEX_SPACE(TmpC));
 
-        if (strchr(TmpPtr, *BPtr))
+        if (strchr(Chars, *BPtr))
         {
-            PSERR2(CmdPtr - Buf, CmdLen, emNoCharMean, CmdBuffer, *BPtr);
+            PSERR2(CmdPtr - cs->Buf, CmdLen, emNoCharMean, cs->CmdBuffer, *BPtr);
         }
     }
 
     /* LaTeX environment tracking */
-    if (!strcmp(CmdBuffer, "\\begin") || !strcmp(CmdBuffer, "\\end"))
+    if ((Info->Builtin == biBegin) || (Info->Builtin == biEnd))
     {
         if (ArgEndPtr)
         {
-            if (!strcmp(ArgBuffer, "document"))
-                InHeader = FALSE;
+            if (!strcmp(cs->ArgBuffer, "document"))
+                cs->InHeader = FALSE;
 
-            if (CmdBuffer[1] == 'b')
+            if (cs->CmdBuffer[1] == 'b')
             {
-                if (!(PushErr(ArgBuffer, Line, CmdPtr - Buf,
-                              CmdLen, RealBuf, &EnvStack)))
+                if (!(PushErr(CurStkName(cs), cs->ArgBuffer, cs->Line,
+                              CmdPtr - cs->Buf, CmdLen, ThisLine(cs),
+                              &cs->EnvStack)))
                     PrintPrgErr(pmNoStackMem);
             }
             else
             {
-                if ((ei = PopErr(&EnvStack)))
+                if ((ei = PopErr(&cs->EnvStack)))
                 {
-                    if (strcmp(ei->Data, ArgBuffer))
-                        PrintError(CurStkName(&InputStack), RealBuf,
-                                   CmdPtr - Buf,
-                                   (long) strlen(CmdBuffer),
-                                   Line, emExpectC, ei->Data, ArgBuffer);
+                    if (strcmp(ei->Data, cs->ArgBuffer))
+                        PrintError(cs, CurStkName(cs), cs->RealBuf,
+                                   CmdPtr - cs->Buf,
+                                   (long) strlen(cs->CmdBuffer),
+                                   cs->Line, emExpectC, ei->Data, cs->ArgBuffer);
 
                     FreeErrInfo(ei);
                 }
                 else
-                    PrintError(CurStkName(&InputStack), RealBuf,
-                               CmdPtr - Buf,
-                               (long) strlen(CmdBuffer),
-                               Line, emSoloC, ArgBuffer);
+                    PrintError(cs, CurStkName(cs), cs->RealBuf,
+                               CmdPtr - cs->Buf,
+                               (long) strlen(cs->CmdBuffer),
+                               cs->Line, emSoloC, cs->ArgBuffer);
             }
 
-            PerformEnv(ArgBuffer, (int) CmdBuffer[1] == 'b');
+            PerformEnv(cs, cs->ArgBuffer, (int) cs->CmdBuffer[1] == 'b');
         }
         else
-            PSERR(CmdPtr - Buf, CmdLen, emNoArgFound);
+            PSERR(CmdPtr - cs->Buf, CmdLen, emNoArgFound);
     }
 
 #if USE_CONTEXT
     /* ConTeXt \start \stop tracking */
-    if (!strncmp(CmdBuffer, "\\start", 6) || !strncmp(CmdBuffer, "\\stop", 5))
+    if (!strncmp(cs->CmdBuffer, "\\start", 6) || !strncmp(cs->CmdBuffer, "\\stop", 5))
     {
-        if (CmdBuffer[3] == 'a') /* start */
+        if (cs->CmdBuffer[3] == 'a') /* start */
         {
-            TmpPtr = CmdBuffer + 6;
-            if (!(PushErr(TmpPtr, Line, CmdPtr - Buf + 6,
-                          CmdLen - 6, RealBuf, &EnvStack)))
+            TmpPtr = cs->CmdBuffer + 6;
+            if (!(PushErr(CurStkName(cs), TmpPtr, cs->Line,
+                          CmdPtr - cs->Buf + 6, CmdLen - 6, ThisLine(cs),
+                          &cs->EnvStack)))
                 PrintPrgErr(pmNoStackMem);
         }
         else
         {
-            TmpPtr = CmdBuffer + 5;
-            if ((ei = PopErr(&EnvStack)))
+            TmpPtr = cs->CmdBuffer + 5;
+            if ((ei = PopErr(&cs->EnvStack)))
             {
                 if (strcmp(ei->Data, TmpPtr))
-                    PrintError(CurStkName(&InputStack), RealBuf,
-                               CmdPtr - Buf + 5,
+                    PrintError(cs, CurStkName(cs), cs->RealBuf,
+                               CmdPtr - cs->Buf + 5,
                                (long) strlen(TmpPtr),
-                               Line, emExpectC, ei->Data, TmpPtr);
+                               cs->Line, emExpectC, ei->Data, TmpPtr);
 
                 FreeErrInfo(ei);
             }
             else
             {
-                PrintError(CurStkName(&InputStack), RealBuf,
-                           CmdPtr - Buf,
-                           (long) strlen(CmdBuffer),
-                           Line, emSoloC, TmpPtr);
+                PrintError(cs, CurStkName(cs), cs->RealBuf,
+                           CmdPtr - cs->Buf,
+                           (long) strlen(cs->CmdBuffer),
+                           cs->Line, emSoloC, TmpPtr);
             }
         }
         /* TODO: Do I need to call PerformEnv? */
@@ -726,294 +986,1203 @@ static void PerformBigCmd(char *CmdPtr)
     }
 #endif
 
-    CheckItal(CmdBuffer);
+    CheckItal(cs, Info);
 
-    if ((ErrNum = PerformCommand(CmdBuffer, BufPtr)))
-        PSERR(CmdPtr - Buf, CmdLen, ErrNum);
+    if ((ErrNum = PerformCommand(cs, cs->CmdBuffer, Info, cs->BufPtr)))
+        PSERR(CmdPtr - cs->Buf, CmdLen, ErrNum);
 
-    if (!strcmp(CmdBuffer, "\\cdots"))
+    if (Info->Builtin == biCDots)
         realdl = dtCDots;
 
-    if (!strcmp(CmdBuffer, "\\ldots"))
-        realdl = dtLDots;
-
-    if (!strcmp(CmdBuffer, "\\dots"))
+    if ((Info->Builtin == biLDots) || (Info->Builtin == biDots))
         realdl = dtLDots;
 
     if (realdl != dtUnknown)
     {
-        dotlev = CheckDots(CmdPtr, BufPtr);
+        dotlev = CheckDots(cs, CmdPtr, cs->BufPtr);
         if (dotlev && (dotlev != realdl))
         {
             const char *cTmpPtr = Dot2Str(dotlev);
-            PSERRA(CmdPtr - Buf, CmdLen, emEllipsis, cTmpPtr);
+            PSERRA(CmdPtr - cs->Buf, CmdLen, emEllipsis, cTmpPtr);
+        }
+    }
+
+    if (Info->WipeArg)
+        WipeArgument(cs, Info->WipeArg, CmdPtr);
+}
+
+/*
+ * Check user abbreviations. Pass a pointer to the `.';
+ * also ensure that it's followed by spaces, etc.
+ *
+ * Walks backwards from the `.' through the reversed trie of
+ * abbreviations, so that every abbreviation which ends there is found
+ * at once, however many there are.
+ */
+
+static void CheckAbbrevs(struct CheckState *cs, const char *Buffer)
+{
+    unsigned long Node = 0;
+    const char *AbbPtr;
+
+    if (INUSE(emInterWord))
+    {
+        /* No abbreviation holds a NUL, so we stop at the start */
+        for (AbbPtr = Buffer; (Node = TrieStep(&Abbrevs, Node, *AbbPtr));)
+        {
+            AbbPtr--;
+            if (Abbrevs.Nodes[Node].Final &&
+                !isalpha((unsigned char)*AbbPtr))
+                PSERR(Buffer - cs->Buf + 1, 1, emInterWord);
+        }
+    }
+}
+
+/*
+ * Builds the reversed trie of abbreviations for CheckAbbrevs(). Call
+ * this once after the configuration has been read, before checking
+ * anything.
+ *
+ * Note: We assume that all abbrevs have been transferred from
+ * AbbrevCase into Abbrev.
+ */
+
+void SetupAbbrevs(void)
+{
+    if (!BuildTrie(&Abbrevs, &Abbrev, TRUE))
+        PrintPrgErr(pmWordListErr);
+}
+
+/*
+ * Builds the tries CheckDots() looks up the context of ellipses in,
+ * and the matcher of DashExcpt for IsDashExcpt(), so that they take
+ * the same time however long the lists are. Call this once after the
+ * configuration has been read, before checking anything.
+ */
+
+void SetupDots(void)
+{
+    if (!BuildTrie(&CDotsBefore, &CenterDots, TRUE) ||
+        !BuildTrie(&CDotsAfter, &CenterDots, FALSE) ||
+        !BuildTrie(&LDotsBefore, &LowDots, TRUE) ||
+        !BuildTrie(&LDotsAfter, &LowDots, FALSE) ||
+        !BuildMatcher(&DashExcpts, &DashExcpt, FALSE))
+        PrintPrgErr(pmWordListErr);
+}
+
+
+/*
+ * The entry for `Name' in the command table, made if need be.
+ */
+
+static struct Command *CommandEntry(const char *Name, struct Command **Free)
+{
+    struct HashSlot *hs = AddHash((char *) Name, &Commands);
+
+    if (!hs->Data)
+        hs->Data = (*Free)++;
+    return (hs->Data);
+}
+
+/*
+ * Builds the command table from the lists. Call this once after the
+ * configuration has been read, before checking anything.
+ */
+
+void SetupCommands(void)
+{
+    static const struct
+    {
+        const char *Name;
+        enum Builtin Builtin;
+    } Builtins[] = {
+        {"\\verb", biVerb},
+        {"\\begin", biBegin},
+        {"\\end", biEnd},
+        {"\\input", biInput},
+        {"\\include", biInclude},
+        {"\\makeatletter", biMakeAtLetter},
+        {"\\makeatother", biMakeAtOther},
+        {"\\cdots", biCDots},
+        {"\\ldots", biLDots},
+        {"\\dots", biDots},
+        {NULL, biNone}
+    };
+
+    static const struct
+    {
+        struct WordList *List;
+        int Flag;
+    } Lists[] = {
+        {&Linker, FLG_Linker},
+        {&PostLink, FLG_PostLink},
+        {&Silent, FLG_Silent},
+        {&IJAccent, FLG_IJAccent},
+        {&NotPreSpaced, FLG_NotPreSpaced},
+        {&MathCmd, FLG_MathCmd},
+        {&TextCmd, FLG_TextCmd},
+        {&Primitives, FLG_Primitives},
+        {&NonItalic, FLG_NonItalic},
+        {&Italic, FLG_Italic},
+        {&ItalCmd, FLG_ItalCmd},
+        {NULL, 0}
+    };
+
+    struct Command *Free;
+    unsigned long i, j, Count;
+
+    ClearHash(&Commands);
+
+    /* At most one entry for each word and builtin; all in one go */
+    Count = (sizeof(Builtins) / sizeof(Builtins[0])) + WipeArg.Stack.Used +
+        NoCharNext.Stack.Used;
+    for (i = 0; Lists[i].List; i++)
+        Count += Lists[i].List->Stack.Used;
+
+    if (!(Free = calloc(Count, sizeof(struct Command))))
+        PrintPrgErr(pmWordListErr);
+
+    for (i = 0; Builtins[i].Name; i++)
+        CommandEntry(Builtins[i].Name, &Free)->Builtin = Builtins[i].Builtin;
+
+    for (i = 0; Lists[i].List; i++)
+    {
+        FORWL(j, *Lists[i].List)
+            CommandEntry(Lists[i].List->Stack.Data[j], &Free)->Flags |=
+                Lists[i].Flag;
+    }
+
+    /* Later entries take precedence, as with HasWord() */
+    FORWL(j, WipeArg)
+        CommandEntry(WipeArg.Stack.Data[j], &Free)->WipeArg =
+            WipeArg.Stack.Data[j];
+    FORWL(j, NoCharNext)
+        CommandEntry(NoCharNext.Stack.Data[j], &Free)->NoCharNext =
+            NoCharNext.Stack.Data[j];
+
+#if HAVE_PCRE || HAVE_POSIX_ERE
+    /*
+     * Match SilentCase against the commands we know now, once for all
+     * checks; only the others need CheckSilentRegex().
+     */
+    if (SilentRegex)
+    {
+        char error[ERROR_STRING_SIZE];
+        struct CheckState *cs;
+        struct Command *Cmd;
+        int rc;
+
+        if (!(cs = NewCheckState(NULL)))
+            PrintPrgErr(pmWordListErr);
+
+        for (i = 0; i < Commands.Size; i++)
+        {
+            if (!Commands.Slots[i].Str)
+                continue;
+            Cmd = Commands.Slots[i].Data;
+            if (Cmd->Flags & FLG_Silent)
+                continue;
+
+            rc = ExecRegex(cs, SilentRegex, Commands.Slots[i].Str, NULL,
+                           NULL, error);
+            if (rc < 0)
+                PrintPrgErr(pmRegexMatchingError, error);
+            else if (rc > 0)
+                Cmd->Flags |= FLG_Silent;
         }
+
+        FreeCheckState(cs);
+    }
+#endif
+}
+
+/*
+ * What we know about the command `Name'.
+ */
+
+static const struct Command *FindCommand(const char *Name)
+{
+    struct HashSlot *hs = FindHash(Name, &Commands);
+
+    return (hs ? hs->Data : &NoCommand);
+}
+
+
+#if HAVE_PCRE || HAVE_POSIX_ERE
+
+/*
+ * Compiles `Pattern' into `re'; if only whether it matches is wanted,
+ * set `NoSub'. Returns FALSE if it doesn't compile, with the reason
+ * in `Error' (of ERROR_STRING_SIZE bytes).
+ *
+ * With PCRE2 the patterns are compiled to machine code where the JIT
+ * is available; the interpreter takes those it can't handle.
+ */
+
+static int CompileRegex(struct Regex *re, const char *Pattern, int NoSub,
+                        char *Error)
+{
+#if HAVE_PCRE2
+    int rc;
+    PCRE2_SIZE Offset;
+
+    re->Code = pcre2_compile((PCRE2_SPTR) Pattern, PCRE2_ZERO_TERMINATED,
+                             NoSub ? PCRE2_NO_AUTO_CAPTURE : 0, &rc,
+                             &Offset, NULL);
+    if (!re->Code)
+    {
+        pcre2_get_error_message(rc, (PCRE2_UCHAR *) Error,
+                                ERROR_STRING_SIZE);
+        return (FALSE);
+    }
+    pcre2_jit_compile(re->Code, PCRE2_JIT_COMPLETE);
+    return (TRUE);
+#else
+    int rc = regcomp(&re->Posix, Pattern,
+                     REGEX_FLAGS | (NoSub ? REG_NOSUB : 0));
+
+    if (rc)
+    {
+        regerror(rc, &re->Posix, Error, ERROR_STRING_SIZE);
+        return (FALSE);
+    }
+    return (TRUE);
+#endif
+}
+
+/*
+ * Looks for `re' in `Str'. Returns 1 if found, with the match from
+ * `*Start' to `*End' if those aren't NULL; 0 if not, and -1 on any
+ * other trouble, described in `Error' (of ERROR_STRING_SIZE bytes) if
+ * that isn't NULL.
+ *
+ * Only the whole match is ever asked for. With PCRE2, its space is kept
+ * in `cs' and reused for every pattern; the patterns are shared by
+ * all states, so it can't be kept with them.
+ */
+
+static int ExecRegex(struct CheckState *cs, struct Regex *re,
+                     const char *Str, long *Start, long *End, char *Error)
+{
+    int rc;
+
+#if HAVE_PCRE2
+    PCRE2_SIZE *Ovector;
+
+    if (!cs->RegexData &&
+        !(cs->RegexData = pcre2_match_data_create(1, NULL)))
+        PrintPrgErr(pmNoRegexMem);
+
+    rc = pcre2_match(re->Code, (PCRE2_SPTR) Str, PCRE2_ZERO_TERMINATED, 0, 0,
+                     cs->RegexData, NULL);
+    if (rc >= 0)
+    {
+        Ovector = pcre2_get_ovector_pointer(cs->RegexData);
+        if (Start)
+            *Start = Ovector[0];
+        if (End)
+            *End = Ovector[1];
+        return (1);
+    }
+    if (rc == PCRE2_ERROR_NOMATCH)
+        return (0);
+
+    if (Error)
+        pcre2_get_error_message(rc, (PCRE2_UCHAR *) Error, ERROR_STRING_SIZE);
+#else
+    regmatch_t Match;
+
+    rc = regexec(&re->Posix, Str, 1, &Match, 0);
+    if (rc == 0)
+    {
+        if (Start)
+            *Start = Match.rm_so;
+        if (End)
+            *End = Match.rm_eo;
+        return (1);
+    }
+    if (rc == REG_NOMATCH)
+        return (0);
+
+    if (Error)
+        regerror(rc, &re->Posix, Error, ERROR_STRING_SIZE);
+#endif
+
+    return (-1);
+}
+
+/*
+ * Whether a pattern means the same as one alternative of several.
+ * Numbered back references and recursion would refer to other groups.
+ */
+
+static int Combinable(const char *Pattern)
+{
+    const char *Ptr;
+
+    for (Ptr = Pattern; *Ptr; Ptr++)
+    {
+        if (*Ptr == '\\')
+        {
+            if (isdigit((unsigned char)Ptr[1]) || Ptr[1] == 'g' || Ptr[1] == 'k')
+                return (FALSE);
+            if (Ptr[1])
+                Ptr++;
+        }
+        else if (Ptr[0] == '(' && Ptr[1] == '?' && Ptr[2] &&
+                 (isdigit((unsigned char)Ptr[2]) || strchr("R&P+-", Ptr[2])))
+            return (FALSE);
+    }
+    return (TRUE);
+}
+
+/* Escapes which take more than the letter after them, or change more */
+#define LONG_ESCAPES "0123456789EgkNopPQcux"
+
+/*
+ * Skips the bracket expression at `Ptr'; NULL if it doesn't end.
+ */
+
+static const char *SkipBracket(const char *Ptr)
+{
+    const char *End;
+
+    Ptr++;
+    if (*Ptr == '^')
+        Ptr++;
+    if (*Ptr == ']')
+        Ptr++;
+
+    while (*Ptr && *Ptr != ']')
+    {
+        /* [:alpha:] and friends */
+        if (Ptr[0] == '[' && Ptr[1] && strchr(":.=", Ptr[1]))
+        {
+            for (End = Ptr + 2; *End && !(End[0] == Ptr[1] && End[1] == ']');)
+                End++;
+            if (!*End)
+                return (NULL);
+            Ptr = End + 2;
+            continue;
+        }
+#if HAVE_PCRE
+        if (*Ptr == '\\' && Ptr[1])
+            Ptr++;
+#endif
+        Ptr++;
+    }
+
+    return (*Ptr ? Ptr + 1 : NULL);
+}
+
+/*
+ * Skips the group at `Ptr'; NULL if it doesn't end.
+ */
+
+static const char *SkipGroup(const char *Ptr)
+{
+    int Depth = 0;
+
+    do
+    {
+        if (*Ptr == '\\')
+        {
+            if (!Ptr[1])
+                return (NULL);
+            Ptr += 2;
+        }
+        else if (*Ptr == '[')
+        {
+            if (!(Ptr = SkipBracket(Ptr)))
+                return (NULL);
+        }
+        else if (!strncmp(Ptr, "(?#", 3))
+        {
+            /* Comments end at the first ) */
+            if (!(Ptr = strchr(Ptr, ')')))
+                return (NULL);
+            Ptr++;
+        }
+        else
+        {
+            if (*Ptr == '(')
+                Depth++;
+            else if (*Ptr == ')')
+                Depth--;
+            Ptr++;
+        }
+    }
+    while (Depth && *Ptr);
+
+    return (Depth ? NULL : Ptr);
+}
+
+/*
+ * Skips the quantifiers at `Ptr', if any; NULL if one doesn't end.
+ */
+
+static const char *SkipQuants(const char *Ptr)
+{
+    while (Ptr && *Ptr && strchr("*+?{", *Ptr))
+    {
+        if (*Ptr == '{')
+        {
+            if ((Ptr = strchr(Ptr, '}')))
+                Ptr++;
+        }
+        else
+            Ptr++;
+    }
+    return (Ptr);
+}
+
+/*
+ * The longest string which any match of `Pattern' has to hold, or NULL
+ * if we can't tell. Only plain characters outside groups, brackets and
+ * alternatives count, and not those which a quantifier may leave out;
+ * whatever we don't understand makes us give up, as a literal which
+ * isn't really needed would lose warnings. Free the result after use.
+ */
+
+static char *RequiredLiteral(const char *Pattern)
+{
+    const char *Ptr = Pattern;
+    unsigned long RunLen = 0, BestLen = 0;
+    char *Run, *Best, Lit;
+
+    Run = malloc(strlen(Pattern) + 1);
+    Best = malloc(strlen(Pattern) + 1);
+    if (!Run || !Best)
+        goto GiveUp;
+
+#define ENDRUN() \
+    if (RunLen > BestLen) \
+    { \
+        memcpy(Best, Run, RunLen); \
+        BestLen = RunLen; \
+    } \
+    RunLen = 0
+
+    while (Ptr && *Ptr)
+    {
+        switch (*Ptr)
+        {
+        case '\\':
+            if (!Ptr[1] || strchr(LONG_ESCAPES, Ptr[1]))
+                goto GiveUp;
+            if (!isalnum((unsigned char)Ptr[1]))
+            {
+                Lit = Ptr[1];
+                Ptr += 2;
+                break;
+            }
+            /* \w, \b and the like */
+            ENDRUN();
+            Ptr = SkipQuants(Ptr + 2);
+            continue;
+        case '(':
+            /* Options such as (?i) or (*UTF) would change the rest */
+            if ((Ptr[1] == '?' && (!Ptr[2] || !strchr(":=!<>#", Ptr[2]))) ||
+                Ptr[1] == '*')
+                goto GiveUp;
+            ENDRUN();
+            Ptr = SkipQuants(SkipGroup(Ptr));
+            continue;
+        case '[':
+            ENDRUN();
+            Ptr = SkipQuants(SkipBracket(Ptr));
+            continue;
+        case '.':
+        case '^':
+        case '$':
+            ENDRUN();
+            Ptr = SkipQuants(Ptr + 1);
+            continue;
+        case '|':
+        case ')':
+        case '*':
+        case '+':
+        case '?':
+        case '{':
+            goto GiveUp;
+        default:
+            Lit = *Ptr++;
+            break;
+        }
+
+        /* The character itself; a quantifier may leave it out */
+        if (*Ptr == '+' && !(Ptr[1] && strchr("*+?{", Ptr[1])))
+        {
+            Run[RunLen++] = Lit;
+            ENDRUN();
+            Ptr++;
+        }
+        else if (*Ptr && strchr("*+?{", *Ptr))
+        {
+            ENDRUN();
+            Ptr = SkipQuants(Ptr);
+        }
+        else
+            Run[RunLen++] = Lit;
+    }
+
+    if (!Ptr)
+        goto GiveUp;
+
+    ENDRUN();
+#undef ENDRUN
+
+    if (BestLen)
+    {
+        Best[BestLen] = '\0';
+        free(Run);
+        return (Best);
+    }
+
+  GiveUp:
+    free(Run);
+    free(Best);
+    return (NULL);
+}
+
+/*
+ * Builds the matcher for the literals of the UserWarnRegex patterns,
+ * which finds those a line holds in one pass; the patterns whose
+ * literal isn't there can't match. `Found' has the literal of each
+ * pattern, or NULL.
+ */
+
+static void SetupLiterals(char **Found)
+{
+    static struct WordList Words;
+    int i;
+
+    ClearWord(&Words);
+    RegexLiterals = (char**)calloc( NumRegexes, sizeof(char*) );
+    LiteralRegex = (unsigned long*)malloc( sizeof(unsigned long) * NumRegexes );
+    RegexTotals = (struct RegexStat*)calloc( NumRegexes, sizeof(struct RegexStat) );
+    if (!RegexLiterals || !LiteralRegex || !RegexTotals)
+        PrintPrgErr(pmNoRegexMem);
+
+    for (i = 0; i < NumRegexes; ++i)
+    {
+        if (Found[i])
+        {
+            LiteralRegex[Words.Stack.Used] = i;
+            if (!InsertWord(Found[i], &Words))
+                PrintPrgErr(pmNoRegexMem);
+            RegexLiterals[i] = Words.Stack.Data[Words.Stack.Used - 1];
+        }
+    }
+
+    if (!BuildMatcher(&Literals, &Words, FALSE))
+        PrintPrgErr(pmNoRegexMem);
+}
+
+/*
+ * Compiles the alternation of the patterns `Lo' to `Hi' - 1 as group
+ * `Node', and those of its halves as groups 2 * `Node' and
+ * 2 * `Node' + 1. A line which no group matches needs no look at any of
+ * its patterns, so most lines cost one regexec() instead of one for each
+ * pattern. `Patterns' has NULL for those which can't be combined; groups
+ * holding them, or which don't compile, are left out.
+ */
+
+static void SetupRegexGroup(char **Patterns, unsigned long Node,
+                            unsigned long Lo, unsigned long Hi)
+{
+    char error[ERROR_STRING_SIZE];
+    unsigned long i, Mid = Lo + (Hi - Lo) / 2;
+    unsigned long len = 1;
+    char *pattern, *tmp;
+
+    if (Hi - Lo < 2)
+        return;
+
+    SetupRegexGroup(Patterns, 2 * Node, Lo, Mid);
+    SetupRegexGroup(Patterns, 2 * Node + 1, Mid, Hi);
+
+    for (i = Lo; i < Hi; i++)
+    {
+        if (!Patterns[i])
+            return;
+        len += strlen(Patterns[i]) + 5;
+    }
+
+    /* (?:A)|(?:B)|..., so that options stay within each */
+    if (!(tmp = (pattern = (char*)malloc( sizeof(char) * len ))))
+        return;
+
+    for (i = Lo; i < Hi; i++)
+    {
+        #if HAVE_PCRE
+        tmp = stpcpy(tmp,"(?:");
+        #else
+        tmp = stpcpy(tmp,"(");
+        #endif
+        tmp = stpcpy(tmp, Patterns[i]);
+        tmp = stpcpy(tmp, ")|");
+    }
+    tmp[-1] = '\0';
+
+    GroupOk[Node] = CompileRegex(&RegexGroups[Node], pattern, TRUE, error);
+    free(pattern);
+}
+
+#endif
+
+/*
+ * Compiles the UserWarnRegex and SilentCase regular expressions.
+ * Call this once after the configuration has been read, before
+ * checking anything; the checks themselves only read the compiled
+ * expressions, so they may run concurrently.
+ */
+
+void SetupRegexes(void)
+{
+#if ! (HAVE_PCRE || HAVE_POSIX_ERE)
+
+    if ((LaTeXMsgs[emUserWarnRegex].InUse == iuOK) &&
+        (UserWarnRegex.Stack.Used > 0))
+    {
+        PrintPrgErr(pmNoRegExp);
+        ClearWord( &UserWarnRegex );
+    }
+
+#else
+
+    char error[ERROR_STRING_SIZE];
+    char *pattern;
+    char *tmp;
+    char **Patterns, **Found;
+    unsigned long Count;
+    int i;
+    int len = 4;                /* Enough for the (?:) */
+
+    if ((LaTeXMsgs[emUserWarnRegex].InUse == iuOK) &&
+        (UserWarnRegex.Stack.Used > 0))
+    {
+        RegexArray = (struct Regex*)malloc( sizeof(struct Regex) * UserWarnRegex.Stack.Used );
+        Patterns = (char**)calloc( UserWarnRegex.Stack.Used, sizeof(char*) );
+        Found = (char**)calloc( UserWarnRegex.Stack.Used, sizeof(char*) );
+        if (!RegexArray || !Patterns || !Found)
+        {
+            /* Allocation failed. */
+            PrintPrgErr(pmNoRegexMem);
+            ClearWord(&UserWarnRegex);
+            NumRegexes = 0;
+        }
+        else
+        {
+            /* The patterns are trimmed in place below */
+            UnshareWords(&UserWarnRegex);
+            NumRegexes = 0;
+            FORWL(Count, UserWarnRegex)
+            {
+                char *CommentEnd = NULL;
+
+                pattern = UserWarnRegex.Stack.Data[Count];
+
+                /* See if it's got a special name that it goes by.
+                   Only use the comment if it's at the very beginning. */
+                if ( strncmp(pattern,"(?#",3) == 0 )
+                {
+                    CommentEnd = strchr(pattern, ')');
+                    /* TODO: check for PCRE/POSIX only regexes */
+                    if ( CommentEnd != NULL )
+                    {
+                        *CommentEnd = '\0';
+                        /* We're leaking a little here, but this was never freed until exit anyway... */
+                        UserWarnRegex.Stack.Data[NumRegexes] = pattern+3;
+
+                        /* Compile past the end of the comment so that it works with POSIX too. */
+                        pattern = CommentEnd + 1;
+                    }
+                }
+
+                /* Ignore PCRE and POSIX specific regexes.
+                 * This is mostly to make testing easier. */
+                if ( strncmp(pattern,"PCRE:",5) == 0 )
+                {
+                    #if HAVE_PCRE
+                    pattern += 5;
+                    #else
+                    continue;
+                    #endif
+                }
+                if ( strncmp(pattern,"POSIX:",6) == 0 )
+                {
+                    #if HAVE_POSIX_ERE
+                    pattern += 6;
+                    #else
+                    continue;
+                    #endif
+                }
+
+                /* Compilation failed: print the error message */
+                if (!CompileRegex(&RegexArray[NumRegexes], pattern, FALSE, error))
+                {
+                    /* TODO: decide whether a non-compiling regex should completely stop, or just be ignored */
+                    PrintPrgErr(pmRegexCompileFailed, pattern, error);
+                }
+                else
+                {
+                    /* Copied, as the pattern may be cleared below */
+                    if ( Combinable(pattern) )
+                    {
+                        Patterns[NumRegexes] = strdup(pattern);
+                    }
+                    Found[NumRegexes] = RequiredLiteral(pattern);
+                    if ( !CommentEnd )
+                    {
+                        ((char*)UserWarnRegex.Stack.Data[NumRegexes])[0] = '\0';
+                    }
+                    ++NumRegexes;
+                }
+            }
+
+            /* A group for each node of a binary tree over them */
+            RegexGroups = (struct Regex*)malloc( sizeof(struct Regex) * 4 * NumRegexes );
+            GroupOk = (char*)calloc( 4 * NumRegexes, sizeof(char) );
+            if (RegexGroups && GroupOk && NumRegexes > 1)
+            {
+                SetupRegexGroup(Patterns, 1, 0, NumRegexes);
+            }
+            SetupLiterals(Found);
+            for (Count = 0; Count < (unsigned long)NumRegexes; ++Count)
+            {
+                free(Patterns[Count]);
+                free(Found[Count]);
+            }
+        }
+        free(Patterns);
+        free(Found);
+    }
+
+    if ((LaTeXMsgs[emSpaceTerm].InUse == iuOK) && (SilentCase.Stack.Used > 0))
+    {
+        /* Find the total length we need */
+        /* There is 1 for | and the final for null terminator */
+        FORWL(i, SilentCase)
+        {
+            len += strlen( SilentCase.Stack.Data[i] ) + 1;
+        }
+
+        /* (A|B|...) */
+        tmp = (pattern = (char*)malloc( sizeof(char) * len ));
+
+        #if HAVE_PCRE
+        tmp = stpcpy(tmp,"(?:");
+        #else
+        tmp = stpcpy(tmp,"(");
+        #endif
+
+        FORWL(i, SilentCase)
+        {
+            tmp = stpcpy(tmp, SilentCase.Stack.Data[i]);
+            *tmp++ = '|';
+        }
+        tmp = stpcpy(tmp - 1, ")");
+
+        SilentRegex = malloc( sizeof(struct Regex) );
+
+        /* Compilation failed: print the error message */
+        if (!CompileRegex(SilentRegex, pattern, FALSE, error))
+        {
+            PrintPrgErr(pmRegexCompileFailed, pattern, error);
+            SilentRegex = NULL;
+        }
+        free(pattern);
+    }
+
+#endif
+}
+
+/*
+ * UserWarn and UserWarnCase are searched for together. UserWarns
+ * holds the words of both, in that order and in lower case; those of
+ * UserWarn are checked again as they are, when found.
+ */
+
+static struct Matcher UserWarns;
+
+#define WARNWORD(w) ((char *) ((w) < UserWarn.Stack.Used ? \
+    UserWarn.Stack.Data[w] : UserWarnCase.Stack.Data[(w) - UserWarn.Stack.Used]))
+
+struct WarnMatch
+{
+    unsigned long Word;         /* Index in UserWarns */
+    long Pos;                   /* Where it starts in Buf */
+};
+
+static void AddWarnMatch(struct CheckState *cs, unsigned long Word, long Pos)
+{
+    if (cs->NumWarnMatches >= cs->MaxWarnMatches)
+    {
+        cs->MaxWarnMatches = max(cs->MaxWarnMatches << 1, 16);
+        if (!(cs->WarnMatches = saferealloc(cs->WarnMatches,
+                                            cs->MaxWarnMatches *
+                                            sizeof(struct WarnMatch))))
+            PrintPrgErr(pmNoStackMem);
+    }
+    cs->WarnMatches[cs->NumWarnMatches].Word = Word;
+    cs->WarnMatches[cs->NumWarnMatches].Pos = Pos;
+    cs->NumWarnMatches++;
+}
+
+static int CmpWarnMatches(const void *a, const void *b)
+{
+    const struct WarnMatch *wa = a, *wb = b;
+
+    if (wa->Word != wb->Word)
+        return (wa->Word < wb->Word ? -1 : 1);
+    return (wa->Pos < wb->Pos ? -1 : (wa->Pos > wb->Pos));
+}
+
+/*
+ * Builds the matcher for UserWarn and UserWarnCase. Call this once
+ * after the configuration has been read, before checking anything.
+ */
+
+void SetupUserWarn(void)
+{
+    static struct WordList Words;
+    unsigned long i;
+
+    ClearWord(&Words);
+    FORWL(i, UserWarn)
+    {
+        if (!InsertWord(UserWarn.Stack.Data[i], &Words))
+            PrintPrgErr(pmWordListErr);
+    }
+    FORWL(i, UserWarnCase)
+    {
+        if (!InsertWord(UserWarnCase.Stack.Data[i], &Words))
+            PrintPrgErr(pmWordListErr);
+    }
+    MakeLower(&Words);
+
+    if (!BuildMatcher(&UserWarns, &Words, TRUE))
+        PrintPrgErr(pmWordListErr);
+}
+
+#if HAVE_PCRE || HAVE_POSIX_ERE
+
+/*
+ * Finds which UserWarnRegex patterns have their literal in the line.
+ * Afterwards, RegexLive[i] tells how many of the patterns before `i'
+ * do, so that a range of them can be checked at once. Returns whether
+ * any does.
+ */
+
+static int FindLiterals(struct CheckState *cs)
+{
+    unsigned long i, Node, n, w, Sum, Live;
+    const char *Ptr;
+
+    if (!cs->RegexLive)
+    {
+        cs->RegexLive = calloc(NumRegexes + 1, sizeof(unsigned long));
+        cs->RegexStats = calloc(NumRegexes, sizeof(struct RegexStat));
+        if (!cs->RegexLive || !cs->RegexStats)
+            PrintPrgErr(pmNoRegexMem);
+    }
+
+    for (i = 0; i < (unsigned long)NumRegexes; i++)
+        cs->RegexLive[i] = !RegexLiterals[i];
+
+    for (Ptr = cs->Buf, Node = 0; *Ptr; Ptr++)
+    {
+        Node = MatchStep(&Literals, Node, *Ptr);
+        for (n = Literals.Out[Node]; n; n = Literals.Out[Literals.Fail[n]])
+        {
+            for (w = Literals.First[n]; w != NOWORD; w = Literals.NextWord[w])
+                cs->RegexLive[LiteralRegex[w]] = TRUE;
+        }
+    }
+
+    cs->RegexLines++;
+    for (i = 0, Sum = 0; i < (unsigned long)NumRegexes; i++)
+    {
+        Live = cs->RegexLive[i];
+        cs->RegexStats[i].Passed += Live;
+        cs->RegexLive[i] = Sum;
+        Sum += Live;
+    }
+    cs->RegexLive[i] = Sum;
+
+    return (Sum > 0);
+}
+
+/*
+ * Adds the counts of `cs' to the totals; see ShowRegexStats().
+ */
+
+static void AddRegexStats(struct CheckState *cs)
+{
+    int i;
+
+    if (!cs->RegexStats || !RegexTotals)
+        return;
+
+#if USE_THREADS
+    pthread_mutex_lock(&RegexStatLock);
+#endif
+    RegexLines += cs->RegexLines;
+    for (i = 0; i < NumRegexes; i++)
+    {
+        RegexTotals[i].Passed += cs->RegexStats[i].Passed;
+        RegexTotals[i].Matched += cs->RegexStats[i].Matched;
+    }
+#if USE_THREADS
+    pthread_mutex_unlock(&RegexStatLock);
+#endif
+}
+
+/*
+ * Reports the matches of UserWarnRegex `Count' in TmpBuffer. Returns
+ * whether there were any.
+ */
+
+static int CheckRegex(struct CheckState *cs, unsigned long Count)
+{
+    char error[ERROR_STRING_SIZE];
+    long Start, End;
+    int rc;
+    int Matched = FALSE;
+    int len = strlen(cs->TmpBuffer);
+    int offset = 0;
+    char *ErrMessage = UserWarnRegex.Stack.Data[Count];
+    const int NamedWarning = strlen(ErrMessage) > 0;
+
+    while (offset < len)
+    {
+        /* Check if this warning should be suppressed. */
+        if (cs->UserLineSuppressions && NamedWarning)
+        {
+            /* The warning can be named with positive or negative numbers. */
+            int UserWarningNumber = abs(atoi(ErrMessage));
+            if (cs->UserLineSuppressions & ((uint64_t)1 << UserWarningNumber))
+            {
+                break;
+            }
+        }
+
+        rc = ExecRegex(cs, &RegexArray[Count], cs->TmpBuffer + offset,
+                       &Start, &End, error);
+        /* Matching failed: handle error cases */
+        if (rc <= 0)
+        {
+            if (rc < 0)
+                PrintPrgErr(pmRegexMatchingError, error);
+
+            offset = len; /* break out of loop */
+        }
+        else
+        {
+            Matched = TRUE;
+            if ( NamedWarning )
+            {
+                /* User specified error message */
+                PSERR2(offset + Start, End - Start,
+                       emUserWarnRegex,
+                       strlen(ErrMessage), ErrMessage);
+            }
+            else
+            {
+                /* Default -- show the match */
+                PSERR2(offset + Start, End - Start,
+                       emUserWarnRegex,
+                       /* The format specifier expects an int */
+                       (int)(End - Start),
+                       cs->TmpBuffer + offset + Start);
+            }
+            if ( End == 0 )
+            {
+                /* Break out of loop if the match was empty.
+                 * This avoids an infinite loop when the match
+                 * is empty, e.g $ */
+                offset = len;
+            }
+            else
+            {
+                offset += End;
+            }
+        }
+    }
+
+    return (Matched);
+}
+
+/*
+ * Reports the matches of UserWarnRegex `Lo' to `Hi' - 1 in TmpBuffer,
+ * in order. `Node' is the group of those, which tells at once if none
+ * of them matches; see SetupRegexGroup(). Those whose literal isn't in
+ * the line are left out; see FindLiterals().
+ */
+
+static void CheckRegexGroup(struct CheckState *cs, unsigned long Node,
+                            unsigned long Lo, unsigned long Hi)
+{
+    unsigned long Mid = Lo + (Hi - Lo) / 2;
+
+    if (cs->RegexLive[Hi] == cs->RegexLive[Lo])
+        return;
+
+    if (Hi - Lo == 1)
+    {
+        if (CheckRegex(cs, Lo))
+            cs->RegexStats[Lo].Matched++;
+    }
+    else if (!GroupOk || !GroupOk[Node] ||
+             ExecRegex(cs, &RegexGroups[Node], cs->TmpBuffer, NULL, NULL,
+                       NULL))
+    {
+        CheckRegexGroup(cs, 2 * Node, Lo, Mid);
+        CheckRegexGroup(cs, 2 * Node + 1, Mid, Hi);
     }
-
-    if ((TmpPtr = HasWord(CmdBuffer, &WipeArg)))
-        WipeArgument(TmpPtr, CmdPtr);
 }
 
+#endif
+
 /*
- * Check user abbreviations. Pass a pointer to the `.';
- * also ensure that it's followed by spaces, etc.
- *
- * Note: We assume that all abbrevs have been transferred from
- * AbbrevCase into Abbrev.
+ * For -d16: how often the literal of each UserWarnRegex pattern was in
+ * a line, and how often the pattern matched then. Literals which are
+ * found much more often than their pattern matches don't help much.
  */
 
-static void CheckAbbrevs(const char *Buffer)
+void ShowRegexStats(void)
 {
-    long i;
-    char *TmpPtr;
-    const char *AbbPtr;
+#if (HAVE_PCRE || HAVE_POSIX_ERE) && !defined(STRIP_DEBUG)
+    unsigned long percent;
+    int i;
 
-    if (INUSE(emInterWord))
-    {
-        TmpPtr = TmpBuffer + Abbrev.MaxLen + 2;
-        *TmpPtr = 0;
-        AbbPtr = Buffer;
+    if (!(DebugLevel & FLG_DbgRunTime) || !RegexTotals)
+        return;
 
-        for (i = Abbrev.MaxLen; i >= 0; i--)
+    fprintf(stderr, "UserWarnRegex literals, in %ld lines:\n", RegexLines);
+    for (i = 0; i < NumRegexes; i++)
+    {
+        if (RegexLiterals[i])
         {
-            *--TmpPtr = *AbbPtr--;
-            if (!isalpha((unsigned char)*AbbPtr) && HasWord(TmpPtr, &Abbrev))
-                PSERR(Buffer - Buf + 1, 1, emInterWord);
-            if (!*AbbPtr)
-                break;
+            percent = RegexLines ?
+                (RegexTotals[i].Passed * 10000) / RegexLines : 0;
+            fprintf(stderr, "\t%3d: `%s' in %ld lines (%ld.%02ld%%), "
+                    "matched %ld\n", i, RegexLiterals[i],
+                    RegexTotals[i].Passed, percent / 100, percent % 100,
+                    RegexTotals[i].Matched);
         }
+        else
+            fprintf(stderr, "\t%3d: No literal, matched %ld\n", i,
+                    RegexTotals[i].Matched);
     }
+#endif
 }
 
-
 /*
  * Check misc. things which can't be included in the main loop.
  *
  */
 
-static void CheckRest(void)
+static void CheckRest(struct CheckState *cs)
 {
-    unsigned long Count;
+    unsigned long Count, Node, n, w;
     long CmdLen;
     char *UsrPtr;
+    const char *Word;
 
     /* Search for user-specified warnings */
 
-#if ! (HAVE_PCRE || HAVE_POSIX_ERE)
+#if HAVE_PCRE || HAVE_POSIX_ERE
 
-    if (INUSE(emUserWarnRegex) && UserWarnRegex.Stack.Used > 0)
-    {
-        PrintPrgErr(pmNoRegExp);
-        ClearWord( &UserWarnRegex );
-    }
-    else if (INUSE(emUserWarn))
+    if (INUSE(emUserWarnRegex) && NumRegexes > 0)
     {
-        strcpy(TmpBuffer, Buf);
+        strcpy(cs->TmpBuffer, cs->Buf);
+        if (FindLiterals(cs))
+            CheckRegexGroup(cs, 1, 0, NumRegexes);
     }
 
-#else
+#endif
 
-    if (INUSE(emUserWarnRegex) && UserWarnRegex.Stack.Used > 0)
-    {
-        static char error[ERROR_STRING_SIZE];
-        static regmatch_t MatchVector[NUM_MATCHES];
-        int rc;
-        int len = strlen(TmpBuffer);
-        strcpy(TmpBuffer, Buf);
 
-        /* Compile all regular expressions if not already compiled. */
-        if ( !RegexArray && UserWarnRegex.Stack.Used > 0 )
+    if (INUSE(emUserWarn))
+    {
+        /* Collect them all in one pass... */
+        cs->NumWarnMatches = 0;
+        for (UsrPtr = cs->Buf, Node = 0; *UsrPtr; UsrPtr++)
         {
-            RegexArray = (regex_t*)malloc( sizeof(regex_t) * UserWarnRegex.Stack.Used );
-            if (!RegexArray)
-            {
-                /* Allocation failed. */
-                PrintPrgErr(pmNoRegexMem);
-                ClearWord(&UserWarnRegex);
-                NumRegexes = 0;
-            }
-            else
+            Node = MatchStep(&UserWarns, Node, *UsrPtr);
+            for (n = UserWarns.Out[Node]; n;
+                 n = UserWarns.Out[UserWarns.Fail[n]])
             {
-                NumRegexes = 0;
-                FORWL(Count, UserWarnRegex)
+                for (w = UserWarns.First[n]; w != NOWORD;
+                     w = UserWarns.NextWord[w])
                 {
-                    char *pattern = UserWarnRegex.Stack.Data[Count];
-                    char *CommentEnd = NULL;
-
-                    /* See if it's got a special name that it goes by.
-                       Only use the comment if it's at the very beginning. */
-                    if ( strncmp(pattern,"(?#",3) == 0 )
-                    {
-                        CommentEnd = strchr(pattern, ')');
-                        /* TODO: check for PCRE/POSIX only regexes */
-                        if ( CommentEnd != NULL )
-                        {
-                            *CommentEnd = '\0';
-                            /* We're leaking a little here, but this was never freed until exit anyway... */
-                            UserWarnRegex.Stack.Data[NumRegexes] = pattern+3;
-
-                            /* Compile past the end of the comment so that it works with POSIX too. */
-                            pattern = CommentEnd + 1;
-                        }
-                    }
-
-                    /* Ignore PCRE and POSIX specific regexes.
-                     * This is mostly to make testing easier. */
-                    if ( strncmp(pattern,"PCRE:",5) == 0 )
-                    {
-                        #if HAVE_PCRE
-                        pattern += 5;
-                        #else
-                        continue;
-                        #endif
-                    }
-                    if ( strncmp(pattern,"POSIX:",6) == 0 )
-                    {
-                        #if HAVE_POSIX_ERE
-                        pattern += 6;
-                        #else
-                        continue;
-                        #endif
-                    }
+                    Word = WARNWORD(w);
+                    CmdLen = strlen(Word);
 
-                    rc = regcomp((regex_t*)(&RegexArray[NumRegexes]),
-                                 pattern, REGEX_FLAGS);
-
-                    /* Compilation failed: print the error message */
-                    if (rc != 0)
-                    {
-                        /* TODO: decide whether a non-compiling regex should completely stop, or just be ignored */
-                        regerror(rc,(regex_t*)(&RegexArray[NumRegexes]),
-                                 error, ERROR_STRING_SIZE);
-                        PrintPrgErr(pmRegexCompileFailed, pattern, error);
-                    }
-                    else
-                    {
-                        if ( !CommentEnd )
-                        {
-                            ((char*)UserWarnRegex.Stack.Data[NumRegexes])[0] = '\0';
-                        }
-                        ++NumRegexes;
-                    }
+                    /* UserWarn is case sensitive */
+                    if ((w >= UserWarn.Stack.Used) ||
+                        !strncmp(UsrPtr + 1 - CmdLen, Word, CmdLen))
+                        AddWarnMatch(cs, w, UsrPtr + 1 - CmdLen - cs->Buf);
                 }
             }
         }
 
-        for (Count = 0; Count < NumRegexes; ++Count)
+        /* ...but report them in the order of the lists, as always */
+        if (cs->NumWarnMatches > 1)
+            qsort(cs->WarnMatches, cs->NumWarnMatches,
+                  sizeof(struct WarnMatch), CmpWarnMatches);
+
+        for (Count = 0; Count < cs->NumWarnMatches; Count++)
         {
-            int offset = 0;
-            char *ErrMessage = UserWarnRegex.Stack.Data[Count];
-            const int NamedWarning = strlen(ErrMessage) > 0;
+            Word = WARNWORD(cs->WarnMatches[Count].Word);
+            CmdLen = strlen(Word);
+            PSERRA(cs->WarnMatches[Count].Pos, CmdLen, emUserWarn, Word);
+        }
+    }
+}
 
-            while (offset < len)
-            {
-                /* Check if this warning should be suppressed. */
-                if (UserLineSuppressions && NamedWarning)
-                {
-                    /* The warning can be named with positive or negative numbers. */
-                    int UserWarningNumber = abs(atoi(ErrMessage));
-                    if (UserLineSuppressions & ((uint64_t)1 << UserWarningNumber))
-                    {
-                        break;
-                    }
-                }
 
-                rc = regexec( (regex_t*)(&RegexArray[Count]), TmpBuffer+offset,
-                              NUM_MATCHES, MatchVector, 0);
-                /* Matching failed: handle error cases */
-                if (rc != 0)
-                {
-                    switch(rc)
-                    {
-                        case REG_NOMATCH:
-                            /* no match, no problem */
-                            break;
-                        default:
-                            regerror(rc, (regex_t*)(&RegexArray[Count]),
-                                     error, ERROR_STRING_SIZE);
-                            PrintPrgErr(pmRegexMatchingError, error);
-                            break;
-                    }
+/*
+ * Whether the dashes at BufPtr (the second one of the run) are part of
+ * a word in DashExcpt. Such a word has to cover BufPtr, so only the
+ * text at most DashExcpt.MaxLen bytes to either side is searched.
+ */
 
-                    offset = len; /* break out of loop */
-                }
-                else
-                {
-#define MATCH (MatchVector[0])
-                    if ( NamedWarning )
-                    {
-                        /* User specified error message */
-                        PSERR2(offset + MATCH.rm_so, MATCH.rm_eo - MATCH.rm_so,
-                               emUserWarnRegex,
-                               strlen(ErrMessage), ErrMessage);
-                    }
-                    else
-                    {
-                        /* Default -- show the match */
-                        PSERR2(offset + MATCH.rm_so, MATCH.rm_eo - MATCH.rm_so,
-                               emUserWarnRegex,
-                               /* The format specifier expects an int */
-                               (int)(MATCH.rm_eo - MATCH.rm_so),
-                               TmpBuffer + offset + MATCH.rm_so);
-                    }
-                    if ( MATCH.rm_eo == 0 )
-                    {
-                        /* Break out of loop if the match was empty.
-                         * This avoids an infinite loop when the match
-                         * is empty, e.g $ */
-                        offset = len;
-                    }
-                    else
-                    {
-                        offset += MATCH.rm_eo;
-                    }
-#undef MATCH
-                }
-            }
-        }
-    }
-    else if (INUSE(emUserWarn))
-    {
-        strcpy(TmpBuffer, Buf);
-    }
+static int IsDashExcpt(struct CheckState *cs)
+{
+    unsigned long Node = 0, n, Max = DashExcpt.MaxLen;
+    const char *Ptr, *End = cs->BufPtr + Max;
 
-#endif
+    if (*cs->BufPtr != '-')
+        return (FALSE);
 
+    Ptr = ((unsigned long) (cs->BufPtr - cs->Buf) >= Max) ?
+        cs->BufPtr - Max + 1 : cs->Buf;
 
-    if (INUSE(emUserWarn))
+    for (; *Ptr && (Ptr < End); Ptr++)
     {
-        FORWL(Count, UserWarn)
-        {
-            for (UsrPtr = TmpBuffer;
-                 (UsrPtr = strstr(UsrPtr, UserWarn.Stack.Data[Count]));
-                 UsrPtr++)
-            {
-                CmdLen = strlen(UserWarn.Stack.Data[Count]);
-                PSERRA(UsrPtr - TmpBuffer, CmdLen, emUserWarn, UserWarn.Stack.Data[Count]);
-            }
-        }
-
-        strlwr(TmpBuffer);
+        Node = MatchStep(&DashExcpts, Node, *Ptr);
+        if (Ptr < cs->BufPtr)
+            continue;
 
-        FORWL(Count, UserWarnCase)
+        for (n = DashExcpts.Out[Node]; n;
+             n = DashExcpts.Out[DashExcpts.Fail[n]])
         {
-            for (UsrPtr = TmpBuffer;
-                 (UsrPtr = strstr(UsrPtr, UserWarnCase.Stack.Data[Count]));
-                 UsrPtr++)
-            {
-                CmdLen = strlen(UserWarnCase.Stack.Data[Count]);
-                PSERRA(UsrPtr - TmpBuffer, CmdLen, emUserWarn, UserWarnCase.Stack.Data[Count]);
-            }
+            if ((unsigned long) (Ptr - cs->BufPtr) <
+                strlen(DashExcpt.Stack.Data[DashExcpts.First[n]]))
+                return (TRUE);
         }
     }
+    return (FALSE);
 }
 
-
 /*
  * Checks that the dash-len is correct.
  */
 
-static void CheckDash(void)
+static void CheckDash(struct CheckState *cs)
 {
     char *TmpPtr;
     int TmpC;
@@ -1021,13 +2190,13 @@ static void CheckDash(void)
     struct WordList *wl = NULL;
     unsigned long i;
     int Errored;
-    char *PrePtr = &BufPtr[-2];
+    char *PrePtr = &cs->BufPtr[-2];
 
-    TmpPtr = BufPtr;
+    TmpPtr = cs->BufPtr;
     SKIP_AHEAD(TmpPtr, TmpC, TmpC == '-');
-    TmpCount = TmpPtr - BufPtr + 1;
+    TmpCount = TmpPtr - cs->BufPtr + 1;
 
-    if (MathMode)
+    if (cs->MathMode)
     {
         if (TmpCount > 1)
             HERE(TmpCount, emWrongDash);
@@ -1054,42 +2223,7 @@ static void CheckDash(void)
                 }
             }
 
-            if (Errored)
-            {
-                struct WordList *el = &DashExcpt;
-
-                FORWL(i, *el)
-                {
-                    char *exception = el->Stack.Data[i];
-
-                    char *e = exception;
-                    while ( *e )
-                    {
-                        if ( *e == '-' && 0 == strncmp( BufPtr, e, strlen(e) ) )
-                        {
-                            char *f = e;
-                            TmpPtr = BufPtr;
-                            while ( f > exception && *(--f) == *(--TmpPtr) )
-                            {
-                                /* Nothing */
-                            }
-
-                            if ( f <= exception && *f == *TmpPtr )
-                            {
-                                Errored = FALSE;
-                                break;
-                            }
-                        }
-
-                        ++e;
-                    }
-
-                    if ( !Errored )
-                        break;
-                }
-            }
-
-            if (Errored)
+            if (Errored && !IsDashExcpt(cs))
                 HERE(TmpCount, emWrongDash);
         }
     }
@@ -1100,7 +2234,7 @@ static void CheckDash(void)
  *
  */
 
-static void HandleBracket(char Char)
+static void HandleBracket(struct CheckState *cs, char Char)
 {
     unsigned long BrOffset;     /* Offset into BrOrder array */
     struct ErrInfo *ei;
@@ -1108,21 +2242,21 @@ static void HandleBracket(char Char)
     char ABuf[2], BBuf[2];
     char *TmpPtr;
 
-    AddBracket(Char);
+    AddBracket(cs->Brackets, Char);
 
     if ((BrOffset = BrackIndex(Char)) != ~0UL)
     {
         if (BrOffset & 1)       /* Closing bracket of some sort */
         {
-            if ((ei = PopErr(&CharStack)))
+            if ((ei = PopErr(&cs->CharStack)))
             {
                 Match = MatchBracket(*(ei->Data));
                 /* Return italics to proper state */
                 if (ei->Flags & efNoItal)
                 {
-                    if (ItState == itOn)
+                    if (cs->ItState == itOn)
                     {
-                        TmpPtr = BufPtr;
+                        TmpPtr = cs->BufPtr;
                         SKIP_AHEAD(TmpPtr, TmpC, TmpC == '}');
 
                         /* If the next character is a period or comma,
@@ -1135,19 +2269,19 @@ static void HandleBracket(char Char)
                             HERE(1, emNoItFound);
                     }
 
-                    ItState = FALSE;
+                    cs->ItState = FALSE;
                 }
                 else if (ei->Flags & efItal)
-                    ItState = TRUE;
+                    cs->ItState = TRUE;
 
                 /* Same for math mode */
                 if (ei->Flags & efMath)
                 {
-                    MathMode = 1;
+                    cs->MathMode = 1;
                 }
                 else if (ei->Flags & efNoMath)
                 {
-                    MathMode = 0;
+                    cs->MathMode = 0;
                 }
 
                 FreeErrInfo(ei);
@@ -1161,8 +2295,8 @@ static void HandleBracket(char Char)
                 BBuf[0] = Char;
                 ABuf[1] = BBuf[1] = 0;
                 if (Match)
-                    PrintError(CurStkName(&InputStack), RealBuf,
-                               BufPtr - Buf - 1, 1, Line, emExpectCB,
+                    PrintError(cs, CurStkName(cs), cs->RealBuf,
+                               cs->BufPtr - cs->Buf - 1, 1, cs->Line, emExpectCB,
                                ABuf, BBuf);
                 else
                     HEREA(1, emSoloCB, BBuf);
@@ -1171,29 +2305,30 @@ static void HandleBracket(char Char)
         }
         else                    /* Opening bracket of some sort  */
         {
-            if ((ei = PushChar(Char, Line, BufPtr - Buf - 1,
-                               &CharStack, RealBuf)))
+            if ((ei = PushChar(CurStkName(cs), Char, cs->Line,
+                               cs->BufPtr - cs->Buf - 1, &cs->CharStack,
+                               ThisLine(cs))))
             {
                 if (Char == '{')
                 {
-                    switch (ItFlag)
+                    switch (cs->ItFlag)
                     {
                     default:
-                        ei->Flags |= ItFlag;
-                        ItFlag = efNone;
+                        ei->Flags |= cs->ItFlag;
+                        cs->ItFlag = efNone;
                         break;
                     case efNone:
-                        ei->Flags |= ItState ? efItal : efNoItal;
+                        ei->Flags |= cs->ItState ? efItal : efNoItal;
                     }
 
-                    switch (MathFlag)
+                    switch (cs->MathFlag)
                     {
                     default:
-                        ei->Flags |= MathFlag;
-                        MathFlag = efNone;
+                        ei->Flags |= cs->MathFlag;
+                        cs->MathFlag = efNone;
                         break;
                     case efNone:
-                        ei->Flags |= MathMode ? efMath : efNoMath;
+                        ei->Flags |= cs->MathMode ? efMath : efNoMath;
                     }
                 }
             }
@@ -1206,131 +2341,243 @@ static void HandleBracket(char Char)
 
 
 /*
- * Checks to see if CmdBuffer matches any of the words in Silent, or
- * any of the regular expressions in SilentCase.
+ * Checks to see if CmdBuffer matches any of the regular expressions
+ * in SilentCase.  The plain words in Silent are in the command table,
+ * and SetupCommands() has already matched the other names in it, so
+ * this is only for commands not in the table.
  *
+ * The answer only depends on the command, so it is remembered for
+ * each one; the configuration doesn't change while `cs' is around,
+ * and the cache is kept for all the documents it checks.
  */
 
-int CheckSilentRegex(void)
+#if HAVE_PCRE || HAVE_POSIX_ERE
+static const char SilentYes = TRUE, SilentNo = FALSE;
+#endif
+
+int CheckSilentRegex(struct CheckState *cs)
 {
 
 #if ! (HAVE_PCRE || HAVE_POSIX_ERE)
 
-    return HasWord(CmdBuffer, &Silent) != NULL;
+    return 0;
 
 #else
 
-    static char error[ERROR_STRING_SIZE];
-    char *pattern;
-    char *tmp;
-    int i;
+    char error[ERROR_STRING_SIZE];
+    struct HashSlot *hs;
+    char *Name;
     int rc;
-    int len = 4;                /* Enough for the (?:) */
 
-    /* Initialize regular expression */
-    if (INUSE(emSpaceTerm) && SilentCase.Stack.Used > 0)
+    if (!SilentRegex)
+        return 0;
+
+    if ((hs = FindHash(cs->CmdBuffer, &cs->SilentCache)))
+        return (*(const char *) hs->Data);
+
+    /* Check against the regexes */
+    rc = ExecRegex(cs, SilentRegex, cs->CmdBuffer, NULL, NULL, error);
+    if (rc < 0)
+        PrintPrgErr(pmRegexMatchingError, error);
+
+    if ((Name = strdup(cs->CmdBuffer)))
+        AddHash(Name, &cs->SilentCache)->Data =
+            (void *) ((rc > 0) ? &SilentYes : &SilentNo);
+
+    return (rc > 0);
+
+#endif
+}
+
+/*
+ * Creates a fresh state for checking documents, reporting errors to
+ * `Output'. Returns NULL if we're out of memory.
+ */
+
+struct CheckState *NewCheckState(FILE *Output)
+{
+    struct CheckState *cs;
+
+    if ((cs = calloc(1, sizeof(struct CheckState))))
     {
-        /* Find the total length we need */
-        /* There is 1 for | and the final for null terminator */
-        FORWL(i, SilentCase)
-        {
-            len += strlen( SilentCase.Stack.Data[i] ) + 1;
-        }
+        cs->OutputFile = Output;
+        cs->StatusFile = stderr;
+        ResetCheckState(cs);
+    }
+    else
+        PrintPrgErr(pmNoStackMem);
 
-        /* (A|B|...) */
-        tmp = (pattern = (char*)malloc( sizeof(char) * len ));
+    return (cs);
+}
 
-        #if HAVE_PCRE
-        tmp = stpcpy(tmp,"(?:");
-        #else
-        tmp = stpcpy(tmp,"(");
-        #endif
+/*
+ * Releases the names of the files we're done with; nothing may refer
+ * to them any longer.
+ */
 
-        FORWL(i, SilentCase)
-        {
-            tmp = stpcpy(tmp, SilentCase.Stack.Data[i]);
-            *tmp++ = '|';
-        }
-        tmp = stpcpy(tmp - 1, ")");
+static void FreeOldNames(struct CheckState *cs)
+{
+    while (cs->OldNames.Used)
+        free(StkPop(&cs->OldNames));
+}
 
-        SilentRegex = malloc( sizeof(regex_t) );
-        rc = regcomp(SilentRegex, pattern, REGEX_FLAGS);
+/*
+ * Prepares `cs' for checking another document.
+ */
 
-        /* Compilation failed: print the error message */
-        if (rc != 0)
+void ResetCheckState(struct CheckState *cs)
+{
+    unsigned long Count;
+
+    for (Count = 0; Count < NUMBRACKETS; Count++)
+        cs->Brackets[Count] = 0L;
+
+#define DEF(type, name, value) cs->name = value
+    STATE_VARS;
+#undef DEF
+
+    /*
+     * Nothing may leak from one document into the next, or the result
+     * would depend on which documents were checked before it.
+     */
+    cs->LastWasComment = cs->SeenSpace = FALSE;
+    cs->ItFlag = cs->MathFlag = efNone;
+    cs->LastName = "";
+    cs->LastLine = 0L;
+    FreeOldNames(cs);
+}
+
+/*
+ * Releases `cs' and everything it holds on to.
+ */
+
+void FreeCheckState(struct CheckState *cs)
+{
+    struct FileNode *fn;
+    unsigned long Count;
+
+    if (cs)
+    {
+        /* Skip the rest of the input, so FGetsStk() releases it */
+        while ((fn = StkTop(&cs->InputStack)))
         {
-            regerror(rc, SilentRegex, error, ERROR_STRING_SIZE);
-            PrintPrgErr(pmRegexCompileFailed, pattern, error);
-            SilentRegex = NULL;
+            fn->Pos = fn->Size;
+            FGetsStk(cs, &Count);
         }
-        /* Ensure we won't initialize it again */
-        SilentCase.Stack.Used = 0;
-        free(pattern);
+        FreeOldNames(cs);
+        FreeErrStack(&cs->CharStack);
+        FreeErrStack(&cs->EnvStack);
+
+        /* Checkpoints may still refer to the last line; see Recheck.c */
+        RetireLine(cs);
+        free(cs->CurLine);
+
+        free(cs->InputStack.Data);
+        free(cs->OldNames.Data);
+        free(cs->WarnMatches);
+#if HAVE_PCRE || HAVE_POSIX_ERE
+        AddRegexStats(cs);
+#endif
+#if HAVE_PCRE2
+        pcre2_match_data_free(cs->RegexData);
+#endif
+        free(cs->RegexLive);
+        free(cs->RegexStats);
+
+        for (Count = 0; Count < cs->SilentCache.Size; Count++)
+            free(cs->SilentCache.Slots[Count].Str);
+        free(cs->SilentCache.Slots);
+
+#define FREEBUF(name) if (cs->name) free(cs->name - WALLBYTES)
+        FREEBUF(RealBuf);
+        FREEBUF(Buf);
+        FREEBUF(CmdBuffer);
+        FREEBUF(ArgBuffer);
+        FREEBUF(TmpBuffer);
+        FREEBUF(VBStr);
+        FREEBUF(MsgBuf);
+#undef FREEBUF
+
+        free(cs);
     }
+}
 
-    /* Check against the normal */
-    if ( HasWord(CmdBuffer, &Silent) )
-        return 1;
-    if (!SilentRegex)
-        return 0;
+/*
+ * Checks everything on `cs->InputStack', and then reports what was
+ * left open at the end. Returns EXIT_FAILURE if any errors were found.
+ */
 
-    /* Check against the regexes */
-    rc = regexec(SilentRegex, CmdBuffer, 0, NULL, 0);
-    if (rc == 0)
-        return 1;
+int CheckInput(struct CheckState *cs)
+{
+    unsigned long LineLen;
+    const char *Line;
+    int ret, Retval = EXIT_SUCCESS;
 
-    /* Matching failed: handle error cases */
-    switch(rc)
+    if (StkTop(&cs->InputStack))
     {
-        case REG_NOMATCH:
-            return 0;
-            break;
-        default:
-            regerror(rc, SilentRegex, error, ERROR_STRING_SIZE);
-            PrintPrgErr(pmRegexMatchingError, error);
-            break;
+        while ((!cs->OutputFile || !ferror(cs->OutputFile))
+               && (Line = FGetsStk(cs, &LineLen)))
+        {
+            ret = FindErr(cs, Line, LineLen, CurStkLine(cs));
+            if ( ret != EXIT_SUCCESS ) {
+                Retval = ret;
+            }
+        }
+
+        PrintStatus(cs, CurStkLine(cs));
     }
-    return 0;
 
-#endif
+    return (Retval);
 }
 
 /*
- * Searches the `Buf' for possible errors, and prints the errors. `Line'
- * is supplied for error printing.
+ * Searches the line `Src' (`Len' bytes as read from the file, not
+ * necessarily NUL terminated) for possible errors, and prints the
+ * errors to `cs->OutputFile'. `_Line' is supplied for error printing.
  */
 
-int FindErr(const char *_RealBuf, const unsigned long _Line)
+int FindErr(struct CheckState *cs, const char *Src, const unsigned long Len,
+            const unsigned long _Line)
 {
     char *CmdPtr;               /* We'll have to copy each command out. */
     char *PrePtr;               /* Ptr to char in front of command, NULL if
                                  * the cmd appears as the first character  */
     char *TmpPtr;               /* Temporary pointer */
     char *ErrPtr;               /* Ptr to where an error started */
+    char *EndPtr;               /* The end of the line */
+    int Mask;
 
     char TmpC,                  /* Just a temp var used throughout the proc. */
       MatchC, Char;             /* Char. currently processed */
     unsigned long CmdLen;       /* Length of misc. things */
     int MixingQuotes;
+    const struct Command *Info; /* What we know of the current command */
 
     int (*pstcb) (int c);
 
     enum DotLevel dotlev;
 
-    FoundErr = EXIT_SUCCESS;
+    cs->FoundErr = EXIT_SUCCESS;
 
-    if (_RealBuf)
+    if (Src)
     {
-        RealBuf = _RealBuf;
-        Line = _Line;
+        cs->Line = _Line;
 
-        if (!LastWasComment)
+        if (!cs->LastWasComment)
         {
-            SeenSpace = TRUE;
+            cs->SeenSpace = TRUE;
         }
-        BufPtr = PreProcess();
+        RetireLine(cs);
+        cs->BufPtr = PreProcess(cs, Src, Len);
 
-        BufPtr = SkipVerb();
+        /* Everything we copy out of the line fits in its own length */
+        CmdLen = strlen(cs->RealBuf) + 1;
+        EndPtr = &cs->Buf[CmdLen - 1];
+        GROWBUF(cs->CmdBuffer, CmdLen);
+        GROWBUF(cs->ArgBuffer, CmdLen);
+        GROWBUF(cs->TmpBuffer, CmdLen);
+
+        cs->BufPtr = SkipVerb(cs);
 
         /* Skip past leading whitespace which is insignificant in TeX to avoid
          * spurious warnings (Delete this space to maintain correct
@@ -1339,15 +2586,24 @@ int FindErr(const char *_RealBuf, const unsigned long _Line)
          * can miss some of Message 30 in the "not SeenSpace" case too, but I
          * think it's less important, since Message 30 is for newbies.
          */
-        if (!SeenSpace && BufPtr)
+        if (!cs->SeenSpace && cs->BufPtr)
         {
-            SKIP_AHEAD(BufPtr, TmpC, LATEX_SPACE(TmpC));
+            SKIP_AHEAD(cs->BufPtr, TmpC, LATEX_SPACE(TmpC));
         }
 
-        while (BufPtr && *BufPtr)
+        while (cs->BufPtr && *cs->BufPtr)
         {
-            PrePtr = BufPtr - 1;
-            Char = *BufPtr++;
+            /* Most of the text doesn't concern any of the cases below */
+            Mask = cs->MathMode ? PLAIN_MATH : PLAIN_TEXT;
+            if (!(PlainClass[(unsigned char) *cs->BufPtr] & Mask))
+            {
+                cs->BufPtr = SkipPlain(cs->BufPtr, EndPtr, Mask);
+                cs->SeenSpace = FALSE;
+                continue;
+            }
+
+            PrePtr = cs->BufPtr - 1;
+            Char = *cs->BufPtr++;
             if (isspace((unsigned char)Char))
                 Char = ' ';
 
@@ -1357,11 +2613,11 @@ int FindErr(const char *_RealBuf, const unsigned long _Line)
                 TmpPtr = NULL;
                 if (isspace((unsigned char)*PrePtr))
                     TmpPtr = PrePtr;
-                else if (isspace((unsigned char)*BufPtr))
-                    TmpPtr = BufPtr;
+                else if (isspace((unsigned char)*cs->BufPtr))
+                    TmpPtr = cs->BufPtr;
 
                 if (TmpPtr)
-                    PSERR(TmpPtr - Buf, 1, emDblSpace);
+                    PSERR(TmpPtr - cs->Buf, 1, emDblSpace);
                 break;
 
             case 'X':
@@ -1373,7 +2629,7 @@ int FindErr(const char *_RealBuf, const unsigned long _Line)
 
                 if (isdigit((unsigned char)*TmpPtr))
                 {
-                    TmpPtr = BufPtr;
+                    TmpPtr = cs->BufPtr;
 
                     SKIP_AHEAD(TmpPtr, TmpC,
                                (LATEX_SPACE(TmpC) || strchr("{}$", TmpC)));
@@ -1434,10 +2690,10 @@ int FindErr(const char *_RealBuf, const unsigned long _Line)
             case 'W':          /* case 'X': */
             case 'Y':
             case 'Z':
-                if (!isalpha((unsigned char)*PrePtr) && (*PrePtr != '\\') && MathMode)
+                if (!isalpha((unsigned char)*PrePtr) && (*PrePtr != '\\') && cs->MathMode)
                 {
-                    TmpPtr = BufPtr;
-                    CmdPtr = CmdBuffer;
+                    TmpPtr = cs->BufPtr;
+                    CmdPtr = cs->CmdBuffer;
                     do
                     {
                         *CmdPtr++ = Char;
@@ -1447,37 +2703,37 @@ int FindErr(const char *_RealBuf, const unsigned long _Line)
 
                     *CmdPtr = 0;
 
-                    if (HasWord(CmdBuffer, &MathRoman))
-                        HEREA(strlen(CmdBuffer), emWordCommand, CmdBuffer);
+                    if (HasWord(cs->CmdBuffer, &MathRoman))
+                        HEREA(strlen(cs->CmdBuffer), emWordCommand, cs->CmdBuffer);
                 }
 
                 break;
             case ' ':
-                TmpPtr = BufPtr;
+                TmpPtr = cs->BufPtr;
                 SKIP_AHEAD(TmpPtr, TmpC, LATEX_SPACE(TmpC));
 
                 if (*TmpPtr && *PrePtr)
                 {
-                    if ((TmpPtr - BufPtr) > 0)
+                    if ((TmpPtr - cs->BufPtr) > 0)
                     {
-                        HERE(TmpPtr - BufPtr + 1, emMultiSpace);
-                        strwrite(BufPtr, VerbClear, TmpPtr - BufPtr - 1);
+                        HERE(TmpPtr - cs->BufPtr + 1, emMultiSpace);
+                        strwrite(cs->BufPtr, VerbClear, TmpPtr - cs->BufPtr - 1);
                     }
                 }
                 break;
 
             case '.':
-                if ((Char == *BufPtr) && (Char == BufPtr[1]))
+                if ((Char == *cs->BufPtr) && (Char == cs->BufPtr[1]))
                 {
                     const char *cTmpPtr;
-                    dotlev = CheckDots(&PrePtr[1], &BufPtr[2]);
+                    dotlev = CheckDots(cs, &PrePtr[1], &cs->BufPtr[2]);
                     cTmpPtr = Dot2Str(dotlev);
                     HEREA(3, emEllipsis, cTmpPtr);
                 }
 
                 /* Regexp: "([^A-Z@.])\.[.!?:]*\s+[a-z]" */
 
-                TmpPtr = BufPtr;
+                TmpPtr = cs->BufPtr;
                 SKIP_AHEAD(TmpPtr, TmpC, strchr(LTX_EosPunc, TmpC));
                 if (LATEX_SPACE(*TmpPtr))
                 {
@@ -1486,9 +2742,9 @@ int FindErr(const char *_RealBuf, const unsigned long _Line)
                     {
                         SKIP_AHEAD(TmpPtr, TmpC, LATEX_SPACE(TmpC));
                         if (islower((unsigned char)*TmpPtr))
-                            PSERR(BufPtr - Buf, 1, emInterWord);
+                            PSERR(cs->BufPtr - cs->Buf, 1, emInterWord);
                         else
-                            CheckAbbrevs(&BufPtr[-1]);
+                            CheckAbbrevs(cs, &cs->BufPtr[-1]);
                     }
                 }
 
@@ -1499,23 +2755,23 @@ int FindErr(const char *_RealBuf, const unsigned long _Line)
             case ';':
                 /* Regexp: "[A-Z][A-Z][.!?:;]\s+" */
 
-                if (isspace((unsigned char)*BufPtr) && isupper((unsigned char)*PrePtr) &&
+                if (isspace((unsigned char)*cs->BufPtr) && isupper((unsigned char)*PrePtr) &&
                     (isupper((unsigned char)PrePtr[-1]) || (Char != '.')))
                     HERE(1, emInterSent);
 
                 /* FALLTHRU */
             case ',':
                 if (isspace((unsigned char)*PrePtr) &&
-                    !(isdigit((unsigned char)*BufPtr) &&
-                      ((BufPtr[-1] == '.') || (BufPtr[-1] == ','))))
-                    PSERR(PrePtr - Buf, 1, emSpacePunct);
+                    !(isdigit((unsigned char)*cs->BufPtr) &&
+                      ((cs->BufPtr[-1] == '.') || (cs->BufPtr[-1] == ','))))
+                    PSERR(PrePtr - cs->Buf, 1, emSpacePunct);
 
-                if (MathMode &&
-                    (((*BufPtr == '$') && (BufPtr[1] != '$')) ||
-                     (!strafter(BufPtr, "\\)"))))
+                if (cs->MathMode &&
+                    (((*cs->BufPtr == '$') && (cs->BufPtr[1] != '$')) ||
+                     (!strafter(cs->BufPtr, "\\)"))))
                     HEREA(1, emPunctMath, "outside inner");
 
-                if (!MathMode &&
+                if (!cs->MathMode &&
                     (((*PrePtr == '$') && (PrePtr[-1] == '$')) ||
                      (!strinfront(PrePtr, "\\]"))))
                     HEREA(1, emPunctMath, "inside display");
@@ -1523,10 +2779,10 @@ int FindErr(const char *_RealBuf, const unsigned long _Line)
                 break;
             case '\'':
             case '`':
-                if ((Char == *BufPtr) && (Char == BufPtr[1]))
+                if ((Char == *cs->BufPtr) && (Char == cs->BufPtr[1]))
                 {
-                    PrintError(CurStkName(&InputStack), RealBuf,
-                               BufPtr - Buf - 1, 3, Line,
+                    PrintError(cs, CurStkName(cs), cs->RealBuf,
+                               cs->BufPtr - cs->Buf - 1, 3, cs->Line,
                                emThreeQuotes,
                                Char, Char, Char, Char, Char, Char);
                 }
@@ -1536,7 +2792,7 @@ int FindErr(const char *_RealBuf, const unsigned long _Line)
                 else
                     MatchC = '\'';
 
-                TmpPtr = BufPtr;
+                TmpPtr = cs->BufPtr;
                 SKIP_AHEAD(TmpPtr, TmpC, TmpC == Char);
 
                 MixingQuotes = FALSE;
@@ -1548,14 +2804,14 @@ int FindErr(const char *_RealBuf, const unsigned long _Line)
                 SKIP_AHEAD(TmpPtr, TmpC, strchr("`\'\"\xB4", TmpC)); /* xB4 = latin1 acute accent */
 
                 if (MixingQuotes)
-                    HERE(TmpPtr - BufPtr + 1, emQuoteMix);
+                    HERE(TmpPtr - cs->BufPtr + 1, emQuoteMix);
 
                 switch (Char)
                 {
                 case '\'':
                     if (isalpha((unsigned char)*TmpPtr) &&
                         (strchr(LTX_GenPunc, *PrePtr) || isspace((unsigned char)*PrePtr)))
-                        HERE(TmpPtr - BufPtr + 1, emBeginQ);
+                        HERE(TmpPtr - cs->BufPtr + 1, emBeginQ);
 
                     /* Now check quote style */
 #define ISPUNCT(ptr) (strchr(LTX_GenPunc, *ptr) && (ptr[-1] != '\\'))
@@ -1571,12 +2827,12 @@ int FindErr(const char *_RealBuf, const unsigned long _Line)
                         {
                             if (*PrePtr && (Quote != quTrad)
                                 && ISPUNCT(PrePtr))
-                                PSERRA(PrePtr - Buf, 1,
+                                PSERRA(PrePtr - cs->Buf, 1,
                                        emQuoteStyle, "in front of");
 
                             if (*TmpPtr && (Quote != quLogic)
                                 && ISPUNCT(TmpPtr))
-                                PSERRA(TmpPtr - Buf, 1,
+                                PSERRA(TmpPtr - cs->Buf, 1,
                                        emQuoteStyle, "after");
                         }
                     }
@@ -1585,10 +2841,10 @@ int FindErr(const char *_RealBuf, const unsigned long _Line)
                 case '`':
                     if (isalpha((unsigned char)*PrePtr) &&
                         (strchr(LTX_GenPunc, *TmpPtr) || isspace((unsigned char)*TmpPtr)))
-                        HERE(TmpPtr - BufPtr + 1, emEndQ);
+                        HERE(TmpPtr - cs->BufPtr + 1, emEndQ);
                     break;
                 }
-                BufPtr = TmpPtr;
+                cs->BufPtr = TmpPtr;
                 break;
             case '"':
                 HERE(1, emUseQuoteLiga);
@@ -1620,10 +2876,10 @@ int FindErr(const char *_RealBuf, const unsigned long _Line)
                         /*[( */
                     case ')':
                     case ']':
-                        PSERR(PrePtr - Buf, CmdLen, emEnclosePar);
+                        PSERR(PrePtr - cs->Buf, CmdLen, emEnclosePar);
                     }
 
-                    TmpPtr = BufPtr;
+                    TmpPtr = cs->BufPtr;
                     SKIP_AHEAD(TmpPtr, TmpC, LATEX_SPACE(TmpC));
 
                     ErrPtr = TmpPtr;
@@ -1640,41 +2896,43 @@ int FindErr(const char *_RealBuf, const unsigned long _Line)
                     TmpPtr--;
 
                     if ((TmpPtr - ErrPtr) > 1)
-                        PSERR(ErrPtr - Buf, TmpPtr - ErrPtr, emEmbrace);
+                        PSERR(ErrPtr - cs->Buf, TmpPtr - ErrPtr, emEmbrace);
                 }
                 break;
             case '-':
-                CheckDash();
+                CheckDash(cs);
                 break;
             case '\\':         /* Command encountered  */
-                BufPtr = GetLTXToken(--BufPtr, CmdBuffer);
+                cs->BufPtr = GetLTXToken(cs, --cs->BufPtr, cs->CmdBuffer);
+                Info = FindCommand(cs->CmdBuffer);
 
-                if (SeenSpace)
+                if (cs->SeenSpace)
                 {
                     /* We must be careful to not point to the "previous space"
                      * when it was actually on the previous line.  This could
                      * cause us to write into someone else's memory (inside of
                      * PrintError). */
-                    if (HasWord(CmdBuffer, &Linker))
-                        PSERR( (PrePtr > Buf) ? (PrePtr - Buf) : 0,
+                    if (Info->Flags & FLG_Linker)
+                        PSERR( (PrePtr > cs->Buf) ? (PrePtr - cs->Buf) : 0,
                                1, emNBSpace);
-                    if (HasWord(CmdBuffer, &PostLink))
-                        PSERR( (PrePtr > Buf) ? (PrePtr - Buf) : 0,
+                    if (Info->Flags & FLG_PostLink)
+                        PSERR( (PrePtr > cs->Buf) ? (PrePtr - cs->Buf) : 0,
                                1, emFalsePage);
                 }
 
-                if (LATEX_SPACE(*BufPtr) && !MathMode &&
-                    !CheckSilentRegex() &&
-                    (strlen(CmdBuffer) != 2))
+                if (LATEX_SPACE(*cs->BufPtr) && !cs->MathMode &&
+                    !(Info->Flags & FLG_Silent) &&
+                    ((Info != &NoCommand) || !CheckSilentRegex(cs)) &&
+                    (strlen(cs->CmdBuffer) != 2))
                 {
-                    PSERR(BufPtr - Buf, 1, emSpaceTerm);
+                    PSERR(cs->BufPtr - cs->Buf, 1, emSpaceTerm);
                 }
-                else if ((*BufPtr == '\\') && (!isalpha((unsigned char)BufPtr[1])) &&
-                         (!LATEX_SPACE(BufPtr[1])))
-                    PSERR(BufPtr - Buf, 2, emNotIntended);
+                else if ((*cs->BufPtr == '\\') && (!isalpha((unsigned char)cs->BufPtr[1])) &&
+                         (!LATEX_SPACE(cs->BufPtr[1])))
+                    PSERR(cs->BufPtr - cs->Buf, 2, emNotIntended);
 
-                PerformBigCmd(PrePtr + 1);
-                BufPtr = SkipVerb();
+                PerformBigCmd(cs, PrePtr + 1, Info);
+                cs->BufPtr = SkipVerb(cs);
 
                 break;
 
@@ -1687,63 +2945,63 @@ int FindErr(const char *_RealBuf, const unsigned long _Line)
                         TmpPtr = PrePtr;
                         SKIP_BACK(TmpPtr, TmpC, istex(TmpC));
                         if (*TmpPtr != '\\')    /* Long cmds */
-                            PSERRA(BufPtr - Buf - 1, 1, emSpaceParen,
+                            PSERRA(cs->BufPtr - cs->Buf - 1, 1, emSpaceParen,
                                    "in front of");
                     }
                 }
-                if (isspace((unsigned char)*BufPtr))
-                    PSERRA(BufPtr - Buf, 1, emNoSpaceParen, "after");
-                HandleBracket(Char);
+                if (isspace((unsigned char)*cs->BufPtr))
+                    PSERRA(cs->BufPtr - cs->Buf, 1, emNoSpaceParen, "after");
+                HandleBracket(cs, Char);
                 break;
 
             case ')':
                 if (isspace((unsigned char)*PrePtr))
-                    PSERRA(BufPtr - Buf - 1, 1, emNoSpaceParen,
+                    PSERRA(cs->BufPtr - cs->Buf - 1, 1, emNoSpaceParen,
                            "in front of");
-                if (isalpha((unsigned char)*BufPtr))
-                    PSERRA(BufPtr - Buf, 1, emSpaceParen, "after");
-                HandleBracket(Char);
+                if (isalpha((unsigned char)*cs->BufPtr))
+                    PSERRA(cs->BufPtr - cs->Buf, 1, emSpaceParen, "after");
+                HandleBracket(cs, Char);
                 break;
 
             case '}':
             case '{':
             case '[':
             case ']':
-                HandleBracket(Char);
+                HandleBracket(cs, Char);
                 break;
             case '$':
                 if (*PrePtr != '\\')
                 {
-                    if (*BufPtr == '$')
+                    if (*cs->BufPtr == '$')
                     {
-                        BufPtr++;
-                        TmpPtr = BufPtr;
+                        cs->BufPtr++;
+                        TmpPtr = cs->BufPtr;
                         SKIP_AHEAD(TmpPtr, TmpC, (TmpC != '$' && TmpC != '\0'));
-                        PSERR(BufPtr - Buf - 2, TmpPtr-BufPtr+4, emDisplayMath);
+                        PSERR(cs->BufPtr - cs->Buf - 2, TmpPtr-cs->BufPtr+4, emDisplayMath);
                     }
                     else
                     {
-                        TmpPtr = BufPtr;
+                        TmpPtr = cs->BufPtr;
                         SKIP_AHEAD(TmpPtr, TmpC, (TmpC != '$' && TmpC != '\0'));
-                        PSERR(BufPtr - Buf - 1, TmpPtr-BufPtr+2, emInlineMath);
+                        PSERR(cs->BufPtr - cs->Buf - 1, TmpPtr-cs->BufPtr+2, emInlineMath);
                     }
-                    MathMode ^= TRUE;
+                    cs->MathMode ^= TRUE;
                 }
 
                 break;
             }
 
-            SeenSpace = LATEX_SPACE(Char);
+            cs->SeenSpace = LATEX_SPACE(Char);
         }
 
-        if (!VerbMode)
+        if (!cs->VerbMode)
         {
-            CheckRest();
+            CheckRest(cs);
         }
 
     }
 
-    return FoundErr;
+    return cs->FoundErr;
 }
 
 /*
@@ -1775,57 +3033,143 @@ static void Transit(FILE * fh, unsigned long Cnt, const char *Str)
  * bracket stack status, math mode, etc.
  */
 
-void PrintStatus(unsigned long Lines)
+void PrintStatus(struct CheckState *cs, unsigned long Lines)
 {
     unsigned long Cnt;
     struct ErrInfo *ei;
 
 
-    while ((ei = PopErr(&CharStack)))
+    while ((ei = PopErr(&cs->CharStack)))
     {
-        PrintError(ei->File, ei->LineBuf, ei->Column,
+        PrintError(cs, ei->File, ei->LineRef->Text, ei->Column,
                    ei->ErrLen, ei->Line, emNoMatchCB, (char *) ei->Data);
         FreeErrInfo(ei);
     }
 
-    while ((ei = PopErr(&EnvStack)))
+    while ((ei = PopErr(&cs->EnvStack)))
     {
-        PrintError(ei->File, ei->LineBuf, ei->Column,
+        PrintError(cs, ei->File, ei->LineRef->Text, ei->Column,
                    ei->ErrLen, ei->Line, emNoMatchC, (char *) ei->Data);
         FreeErrInfo(ei);
     }
 
-    if (MathMode)
+    if (cs->MathMode)
     {
-        PrintError(CurStkName(&InputStack), "", 0L, 0L, Lines, emMathStillOn);
+        PrintError(cs, CurStkName(cs), "", 0L, 0L, Lines, emMathStillOn);
     }
 
     for (Cnt = 0L; Cnt < (NUMBRACKETS >> 1); Cnt++)
     {
-        if (Brackets[Cnt << 1] != Brackets[(Cnt << 1) + 1])
+        if (cs->Brackets[Cnt << 1] != cs->Brackets[(Cnt << 1) + 1])
         {
-            PrintError(CurStkName(&InputStack), "", 0L, 0L, Lines,
+            PrintError(cs, CurStkName(cs), "", 0L, 0L, Lines,
                        emNoMatchCC,
                        BrOrder[Cnt << 1], BrOrder[(Cnt << 1) + 1]);
         }
     }
 
-    if (!Quiet)
+    PrintSummary(cs);
+}
+
+/*
+ * Prints how many errors and warnings were found, unless we're told
+ * to be quiet.
+ */
+
+void PrintSummary(struct CheckState *cs)
+{
+    if (!Quiet && cs->StatusFile)
     {
-        Transit(stderr, ErrPrint, "error%s printed; ");
-        Transit(stderr, WarnPrint, "warning%s printed; ");
-        Transit(stderr, UserSupp, "user suppressed warning%s; ");
-        Transit(stderr, LineSupp, "line suppressed warning%s.\n");
+        Transit(cs->StatusFile, cs->ErrPrint, "error%s printed; ");
+        Transit(cs->StatusFile, cs->WarnPrint, "warning%s printed; ");
+        Transit(cs->StatusFile, cs->UserSupp, "user suppressed warning%s; ");
+        Transit(cs->StatusFile, cs->LineSupp, "line suppressed warning%s.\n");
 
         /* Print how to suppress warnings. */
-        if ( ErrPrint + WarnPrint > 0 ) {
-            fprintf(stderr, "See the manual for how to suppress some or all of these warnings/errors.\n" );
+        if ( cs->ErrPrint + cs->WarnPrint > 0 ) {
+            fprintf(cs->StatusFile, "See the manual for how to suppress some or all of these warnings/errors.\n" );
         }
     }
 }
 
 
 
+/*
+ * Writes `Count' copies of `c' to `fh'.
+ */
+
+static void PrintChars(FILE *fh, int c, long Count)
+{
+    char Chunk[64];
+
+    memset(Chunk, c, sizeof(Chunk));
+    while (Count > 0)
+    {
+        fwrite(Chunk, 1, (size_t) min(Count, (long) sizeof(Chunk)), fh);
+        Count -= (long) sizeof(Chunk);
+    }
+}
+
+/*
+ * Writes at most `Len' characters of `String', starting at `Pos', to
+ * `fh'. Out-of-range requests are clipped. `*SLen' caches the
+ * length of the string; pass -1 if it isn't known yet.
+ */
+
+static void PrintRange(FILE *fh, const char *String, long *SLen,
+                       long Pos, long Len)
+{
+    if (*SLen < 0)
+        *SLen = strlen(String);
+
+    if ((Pos >= 0) && (Pos < *SLen) && (Len > 0))
+        fwrite(&String[Pos], 1, (size_t) min(Len, *SLen - Pos), fh);
+}
+
+/*
+ * Hands an error which PrintError() decided to show over to
+ * `cs->Report', with the message already formatted.
+ */
+
+static void ReportError(struct CheckState *cs, const char *File,
+                        long Position, long Len, long LineNo,
+                        enum ErrNum Error, va_list MsgArgs)
+{
+    struct ChkTeXDiag Diag;
+    va_list Args;
+    int Need;
+
+    va_copy(Args, MsgArgs);
+    Need = vsnprintf(NULL, 0, LaTeXMsgs[Error].Message, Args);
+    va_end(Args);
+
+    GROWBUF(cs->MsgBuf, (unsigned long) max(Need, 0) + 1);
+    vsnprintf(cs->MsgBuf, (size_t) max(Need, 0) + 1,
+              LaTeXMsgs[Error].Message, MsgArgs);
+
+    Diag.File = File;
+    Diag.Line = LineNo;
+    Diag.Column = Position + 1;
+    Diag.Length = Len;
+    Diag.Number = Error;
+    switch (LaTeXMsgs[Error].Type)
+    {
+    case etWarn:
+        Diag.Kind = ckWarning;
+        break;
+    case etErr:
+        Diag.Kind = ckError;
+        break;
+    default:
+    case etMsg:
+        Diag.Kind = ckMessage;
+        break;
+    }
+    Diag.Message = cs->MsgBuf;
+
+    cs->Report(&Diag, cs->ReportData);
+}
+
 /*
  * Uses OutputFormat. Be sure that `String'
  * does not contain tabs, newlines, etc.
@@ -1844,20 +3188,22 @@ void PrintStatus(unsigned long Lines)
  *  %r  - part of line in front of error ('S' - 1)
  *  %s  - part of line which contains error (String)
  *  %t  - part of line after error ('S' + 1)
+ *
+ * If `cs->Report' is set, the error is handed to it instead; see
+ * ChkTeXLib.h.
  */
 
 
 void
-PrintError(const char *File, const char *String,
+PrintError(struct CheckState *cs, const char *File, const char *String,
            const long Position, const long Len,
            const long LineNo, const enum ErrNum Error, ...)
 {
-    static                      /* Just to reduce stack usage... */
-    char PrintBuffer[BUFSIZ];
     va_list MsgArgs;
+    long SLen = -1;
 
-    char *LastNorm = OutputFormat;
-    char *of;
+    const char *LastNorm = OutputFormat;
+    const char *of;
     int c;
 
     enum Context Context;
@@ -1869,11 +3215,11 @@ PrintError(const char *File, const char *String,
         case iuOK:
             if (SUPPRESSED_ON_LINE(Error))
             {
-                LineSupp++;
+                cs->LineSupp++;
             }
             else
             {
-                FoundErr = EXIT_FAILURE;
+                cs->FoundErr = EXIT_FAILURE;
                 Context = LaTeXMsgs[Error].Context;
 
                 if (!HeadErrOut)
@@ -1881,111 +3227,108 @@ PrintError(const char *File, const char *String,
 
 #define RGTCTXT(Ctxt, Var) if((Context & Ctxt) && !(Var)) break;
 
-                RGTCTXT(ctInMath, MathMode);
-                RGTCTXT(ctOutMath, !MathMode);
-                RGTCTXT(ctInHead, InHeader);
-                RGTCTXT(ctOutHead, !InHeader);
+                RGTCTXT(ctInMath, cs->MathMode);
+                RGTCTXT(ctOutMath, !cs->MathMode);
+                RGTCTXT(ctInHead, cs->InHeader);
+                RGTCTXT(ctOutHead, !cs->InHeader);
 
                 switch (LaTeXMsgs[Error].Type)
                 {
                 case etWarn:
-                    WarnPrint++;
+                    cs->WarnPrint++;
                     break;
                 case etErr:
-                    ErrPrint++;
+                    cs->ErrPrint++;
                     break;
                 case etMsg:
                     break;
                 }
 
-                while ((of = strchr(LastNorm, '%')))
+                if (cs->Report)
                 {
-                    c = *of;
-                    *of = 0;
-
-                    fputs(LastNorm, OutputFile);
+                    va_start(MsgArgs, Error);
+                    ReportError(cs, File, Position, Len, LineNo, Error,
+                                MsgArgs);
+                    va_end(MsgArgs);
+                    break;
+                }
 
-                    *of++ = c;
+                while ((of = strchr(LastNorm, '%')))
+                {
+                    fwrite(LastNorm, 1, of - LastNorm, cs->OutputFile);
+                    of++;
 
                     switch (c = *of++)
                     {
                     case 'b':
-                        fputs(Delimit, OutputFile);
+                        fputs(Delimit, cs->OutputFile);
                         break;
                     case 'c':
-                        /* TODO: need to add the offset of the column
-                         * here when long lines are broken. */
-                        fprintf(OutputFile, "%ld", Position + 1);
+                        fprintf(cs->OutputFile, "%ld", Position + 1);
                         break;
                     case 'd':
-                        fprintf(OutputFile, "%ld", Len);
+                        fprintf(cs->OutputFile, "%ld", Len);
                         break;
                     case 'f':
-                        fputs(File, OutputFile);
+                        fputs(File, cs->OutputFile);
                         break;
                     case 'i':
-                        fputs(ReverseOn, OutputFile);
+                        fputs(ReverseOn, cs->OutputFile);
                         break;
                     case 'I':
-                        fputs(ReverseOff, OutputFile);
+                        fputs(ReverseOff, cs->OutputFile);
                         break;
                     case 'k':
                         switch (LaTeXMsgs[Error].Type)
                         {
                         case etWarn:
-                            fprintf(OutputFile, "Warning");
+                            fprintf(cs->OutputFile, "Warning");
                             break;
                         case etErr:
-                            fprintf(OutputFile, "Error");
+                            fprintf(cs->OutputFile, "Error");
                             break;
                         case etMsg:
-                            fprintf(OutputFile, "Message");
+                            fprintf(cs->OutputFile, "Message");
                             break;
                         }
                         break;
                     case 'l':
-                        fprintf(OutputFile, "%ld", LineNo);
+                        fprintf(cs->OutputFile, "%ld", LineNo);
                         break;
                     case 'm':
                         va_start(MsgArgs, Error);
-                        vfprintf(OutputFile,
+                        vfprintf(cs->OutputFile,
                                  LaTeXMsgs[Error].Message, MsgArgs);
                         va_end(MsgArgs);
                         break;
                     case 'n':
-                        fprintf(OutputFile, "%d", Error);
+                        fprintf(cs->OutputFile, "%d", Error);
                         break;
                     case 'u':
-                        sfmemset(PrintBuffer, ' ', (long) Position);
-
-                        sfmemset(&PrintBuffer[Position], '^', Len);
-                        PrintBuffer[Position + Len] = 0;
-                        fputs(PrintBuffer, OutputFile);
+                        PrintChars(cs->OutputFile, ' ', Position + min(Len, 0));
+                        PrintChars(cs->OutputFile, '^', Len);
                         break;
                     case 'r':
-                        substring(String, PrintBuffer, 0L, Position);
-                        fputs(PrintBuffer, OutputFile);
+                        PrintRange(cs->OutputFile, String, &SLen, 0L, Position);
                         break;
                     case 's':
-                        substring(String, PrintBuffer, Position, Len);
-                        fputs(PrintBuffer, OutputFile);
+                        PrintRange(cs->OutputFile, String, &SLen, Position, Len);
                         break;
                     case 't':
-                        substring(String, PrintBuffer,
-                                  Position + Len, LONG_MAX);
-                        fputs(PrintBuffer, OutputFile);
+                        PrintRange(cs->OutputFile, String, &SLen,
+                                   Position + Len, LONG_MAX);
                         break;
                     default:
-                        fputc(c, OutputFile);
+                        fputc(c, cs->OutputFile);
                         break;
                     }
                     LastNorm = of;
                 }
-                fputs(LastNorm, OutputFile);
+                fputs(LastNorm, cs->OutputFile);
             }
             break;
         case iuNotUser:
-            UserSupp++;
+            cs->UserSupp++;
             break;
         case iuNotSys:
             break;
@@ -1999,48 +3342,56 @@ PrintError(const char *File, const char *String,
  * or not.
  */
 
-static enum ErrNum PerformCommand(const char *Cmd, char *Arg)
+static enum ErrNum PerformCommand(struct CheckState *cs, const char *Cmd,
+                                  const struct Command *Info, char *Arg)
 {
     const char *Argument = "";
     enum ErrNum en = emMinFault;
     int TmpC;
 
-    if (!strcmp(Cmd, "\\makeatletter"))
-        AtLetter = TRUE;
-    else if (!strcmp(Cmd, "\\makeatother"))
-        AtLetter = FALSE;
-    else if (InputFiles && !(strcmp(Cmd, "\\input") && strcmp(Cmd, "\\include")))
+    if (Info->Builtin == biMakeAtLetter)
+        cs->AtLetter = TRUE;
+    else if (Info->Builtin == biMakeAtOther)
+        cs->AtLetter = FALSE;
+    else if (InputFiles && ((Info->Builtin == biInput) ||
+                            (Info->Builtin == biInclude)))
     {
         SKIP_AHEAD(Arg, TmpC, LATEX_SPACE(TmpC));
         if (*Arg == '{')        /* } */
         {
-            if (GetLTXArg(Arg, TmpBuffer, GET_STRIP_TOKEN, NULL))
-                Argument = TmpBuffer;
+            if (GetLTXArg(cs, Arg, cs->TmpBuffer, GET_STRIP_TOKEN, NULL))
+                Argument = cs->TmpBuffer;
         }
         else
             Argument = strip(Arg, STRP_BTH);
 
-        if (!(Argument && PushFileName(Argument, &InputStack)))
+        if (Argument && PushFileName(Argument, &cs->InputStack))
+            NoteInput(cs, Argument, StkTop(&cs->InputStack));
+        else
+        {
             en = emNoCmdExec;
+            if (Argument)
+                NoteInput(cs, Argument, NULL);
+        }
     }
-    else if (HasWord(Cmd, &Primitives))
+    else if (Info->Flags & FLG_Primitives)
         en = emTeXPrim;
-    else if (HasWord(Cmd, &MathCmd))
+    else if (Info->Flags & FLG_MathCmd)
     {
         SKIP_AHEAD(Arg, TmpC, LATEX_SPACE(TmpC));
         if (*Arg == '{')
         {
-            MathFlag = MathMode ? efMath : efNoMath;
-            MathMode = 1;
+            cs->MathFlag = cs->MathMode ? efMath : efNoMath;
+            cs->MathMode = 1;
         }
     }
-    else if (HasWord(Cmd, &TextCmd))
+    else if (Info->Flags & FLG_TextCmd)
     {
         SKIP_AHEAD(Arg, TmpC, LATEX_SPACE(TmpC));
         if (*Arg == '{')
         {
-            MathFlag = MathMode ? efMath : efNoMath;
-            MathMode = 0;
+            cs->MathFlag = cs->MathMode ? efMath : efNoMath;
+            cs->MathMode = 0;
         }
     }
     else if (*Cmd == '\\')
@@ -2050,17 +3401,17 @@ static enum ErrNum PerformCommand(const char *Cmd, char *Arg)
         {
         case '(':
         case '[':
-            MathMode = TRUE;
+            cs->MathMode = TRUE;
             break;
         case ']':
         case ')':
-            MathMode = FALSE;
+            cs->MathMode = FALSE;
             break;
         case '/':
-            switch (ItState)
+            switch (cs->ItState)
             {
             case itOn:
-                ItState = itCorrected;
+                cs->ItState = itCorrected;
                 Argument = Arg;
 
                 SKIP_AHEAD(Argument, TmpC, TmpC == '{' || TmpC == '}');
@@ -197,10 +197,26 @@ extern struct ErrMsg LaTeXMsgs[emMaxFault + 1];
 
 extern char *OutputFormat;
 
-int CheckSilentRegex(void);
-int FindErr(const char *, const unsigned long);
-void PrintError(const char *, const char *, const long, const long,
-                const long, const enum ErrNum, ...);
-void PrintStatus(unsigned long Lines);
+struct CheckState;
+
+struct CheckState *NewCheckState(FILE *Output);
+void ResetCheckState(struct CheckState *cs);
+void FreeCheckState(struct CheckState *cs);
+void SetupRegexes(void);
+void SetupCommands(void);
+void SetupAbbrevs(void);
+void SetupDots(void);
+void SetupPlain(void);
+void SetupUserWarn(void);
+void ShowRegexStats(void);
+int CheckInput(struct CheckState *cs);
+
+int CheckSilentRegex(struct CheckState *cs);
+int FindErr(struct CheckState *cs, const char *, const unsigned long,
+            const unsigned long);
+void PrintError(struct CheckState *cs, const char *, const char *,
+                const long, const long, const long, const enum ErrNum, ...);
+void PrintStatus(struct CheckState *cs, unsigned long Lines);
+void PrintSummary(struct CheckState *cs);
 
 #endif /* FINDERRS */
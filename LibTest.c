@@ -0,0 +1,315 @@
+/*
+ *  ChkTeX, tests libchktex.
+ *  Copyright (C) 1995-96 Jens T. Berger Thielemann
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Contact the author at:
+ *              Jens Berger
+ *              Spektrumvn. 4
+ *              N-0666 Oslo
+ *              Norway
+ *              E-mail: <jensthi@ifi.uio.no>
+ *
+ *
+ */
+
+
+#include "ChkTeX.h"
+#include "ChkTeXLib.h"
+#include "Server.h"
+#include <string.h>
+
+/*
+ * `make check' runs us as
+ *
+ *      libtest chktex <options> <file>
+ *
+ * in the directory of <file>. We check <file> through libchktex, with
+ * the <options> chktex gets, and print each report the way chktex
+ * does with -f "%f:%l:%c:%d:%n:%k:%m\n"; the Makefile compares the
+ * two. Besides, we make sure that
+ *
+ *  - calling ChkTeXInit() again changes nothing;
+ *  - an empty document may be passed as NULL, but nothing else may;
+ *  - ChkTeXRecheck() reports what a full check does, after an edit too;
+ *  - --serve answers with the same reports.
+ *
+ * If not, we say so on stderr and fail.
+ */
+
+/*
+ * Inserted into the middle of the document; the `$' and the `(' are
+ * left open, which changes how the rest of it is checked.
+ */
+static const char Edit[] = "Foo... {\\em bar} $(x and y\n";
+
+static const char *KindNames[] = { "Message", "Warning", "Error" };
+
+/* Faulty, but ignored by a second ChkTeXInit() */
+static char *OtherArgs[] = { "chktex", "-w999", NULL };
+
+static const char *Me;
+static int Failed = FALSE;
+
+/*
+ * The reports of one check, in the format above.
+ */
+
+struct Output
+{
+    char *Text;
+    unsigned long Len, Size;
+    int Found;                  /* What the check returned */
+};
+
+static void Append(struct Output *Out, const char *Str, unsigned long Len)
+{
+    if (Out->Len + Len + 1 > Out->Size)
+    {
+        Out->Size = (Out->Len + Len + 1) * 2;
+        if (!(Out->Text = realloc(Out->Text, Out->Size)))
+        {
+            fprintf(stderr, "%s: Out of memory.\n", Me);
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(&Out->Text[Out->Len], Str, Len);
+    Out->Len += Len;
+    Out->Text[Out->Len] = 0;
+}
+
+static void AppendDiag(struct Output *Out, const char *File,
+                       unsigned long Line, long Column, long Length,
+                       int Number, const char *Kind, const char *Message,
+                       unsigned long MsgLen)
+{
+    char Nums[128];
+
+    Append(Out, File, strlen(File));
+    sprintf(Nums, ":%lu:%ld:%ld:%d:", Line, Column, Length, Number);
+    Append(Out, Nums, strlen(Nums));
+    Append(Out, Kind, strlen(Kind));
+    Append(Out, ":", 1);
+    Append(Out, Message, MsgLen);
+    Append(Out, "\n", 1);
+}
+
+static void Collect(const struct ChkTeXDiag *Diag, void *UserData)
+{
+    AppendDiag(UserData, Diag->File, Diag->Line, Diag->Column,
+               Diag->Length, Diag->Number, KindNames[Diag->Kind],
+               Diag->Message, strlen(Diag->Message));
+}
+
+static void CheckDoc(struct Output *Out, const char *Name, const char *Data,
+                     unsigned long Len)
+{
+    Out->Len = 0;
+    Append(Out, "", 0);
+    Out->Found = ChkTeXCheckBuffer(Name, Data, Len, Collect, Out);
+}
+
+static void RecheckDoc(struct Output *Out, struct ChkTeXSession *Session,
+                       const char *Name, const char *Data, unsigned long Len)
+{
+    Out->Len = 0;
+    Append(Out, "", 0);
+    Out->Found = ChkTeXRecheck(Session, Name, Data, Len, Collect, Out);
+}
+
+static void Compare(const char *What, const struct Output *Got,
+                    const struct Output *Full)
+{
+    if ((Got->Found != Full->Found) || strcmp(Got->Text, Full->Text))
+    {
+        fprintf(stderr, "%s: %s differs from a full check.\n", Me, What);
+        Failed = TRUE;
+    }
+}
+
+/*
+ * Reads all of `Name' into `Out->Text'.
+ */
+
+static void ReadAll(struct Output *Out, const char *Name)
+{
+    FILE *fh;
+    char Buf[BUFSIZ];
+    size_t Len;
+
+    if (!(fh = fopen(Name, "rb")))
+    {
+        fprintf(stderr, "%s: Could not open `%s'.\n", Me, Name);
+        exit(EXIT_FAILURE);
+    }
+    Out->Len = 0;
+    Append(Out, "", 0);
+    while ((Len = fread(Buf, 1, sizeof(Buf), fh)))
+        Append(Out, Buf, Len);
+    fclose(fh);
+}
+
+/*
+ * Sends `Data' to ServeStream() as a request for `Name', and reads the
+ * reports from the answer into `Out'.
+ */
+
+static void ServeDoc(struct Output *Out, const char *Name, const char *Data,
+                     unsigned long Len)
+{
+    FILE *In, *Answer;
+    char Line[128], Kind[16], *Field = NULL;
+    unsigned long DiagLine, FileLen, MsgLen, Errors, Warnings;
+    long Column, Length;
+    int Number;
+
+    Out->Len = 0;
+    Append(Out, "", 0);
+    Out->Found = -1;
+
+    if (!(In = tmpfile()) || !(Answer = tmpfile()))
+    {
+        fprintf(stderr, "%s: Could not make a temporary file.\n", Me);
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(In, "CHECK %lu 0 %lu\n%s", (unsigned long) strlen(Name), Len,
+            Name);
+    fwrite(Data, 1, Len, In);
+    fputs("QUIT\n", In);
+    rewind(In);
+    ServeStream(In, Answer);
+    rewind(Answer);
+
+    while (fgets(Line, sizeof(Line), Answer))
+    {
+        if (sscanf(Line, "DIAG %lu %ld %ld %d %15s %lu %lu", &DiagLine,
+                   &Column, &Length, &Number, Kind, &FileLen,
+                   &MsgLen) == 7)
+        {
+            /* The file name and the message, each zero terminated */
+            if (!(Field = realloc(Field, FileLen + MsgLen + 2)) ||
+                (fread(Field, 1, FileLen, Answer) != FileLen) ||
+                (fread(&Field[FileLen + 1], 1, MsgLen, Answer) != MsgLen))
+                break;
+            Field[FileLen] = 0;
+            Field[FileLen + 1 + MsgLen] = 0;
+            AppendDiag(Out, Field, DiagLine, Column, Length, Number, Kind,
+                       &Field[FileLen + 1], MsgLen);
+        }
+        else if (sscanf(Line, "DONE %lu %lu", &Errors, &Warnings) == 2)
+            Out->Found = (int) (Errors + Warnings);
+        else
+            break;
+    }
+
+    free(Field);
+    fclose(In);
+    fclose(Answer);
+}
+
+int main(int argc, char **argv)
+{
+    struct Output File = { NULL, 0, 0, 0 }, Full = { NULL, 0, 0, 0 };
+    struct Output Plain = { NULL, 0, 0, 0 }, Got = { NULL, 0, 0, 0 };
+    struct ChkTeXSession *Session;
+    const char *Name;
+    char *Doc, *Pos;
+    unsigned long Middle;
+
+    Me = argv[0];
+
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s chktex [options] file\n", Me);
+        return (EXIT_FAILURE);
+    }
+    Name = argv[argc - 1];
+
+    /* The file name is ignored, so this is chktex's command line */
+    if (!ChkTeXInit(argc - 1, &argv[1]))
+        return (EXIT_FAILURE);
+
+    ReadAll(&File, Name);
+    CheckDoc(&Full, Name, File.Text, File.Len);
+    fputs(Full.Text, stdout);
+
+    if (!ChkTeXInit(2, OtherArgs))
+    {
+        fprintf(stderr, "%s: ChkTeXInit() failed the second time.\n", Me);
+        Failed = TRUE;
+    }
+    CheckDoc(&Got, Name, File.Text, File.Len);
+    Compare("Checking after a second ChkTeXInit()", &Got, &Full);
+
+    CheckDoc(&Got, Name, NULL, 0);
+    CheckDoc(&Plain, Name, "", 0);
+    Compare("Checking NULL", &Got, &Plain);
+    if (ChkTeXCheckBuffer(Name, NULL, 1, Collect, &Got) != -1)
+    {
+        fprintf(stderr, "%s: ChkTeXCheckBuffer() took NULL data.\n", Me);
+        Failed = TRUE;
+    }
+
+    ServeDoc(&Got, Name, File.Text, File.Len);
+    Compare("--serve", &Got, &Full);
+
+    /*
+     * Documents which \input others are always checked in full, so we
+     * turn those lines into comments before we recheck.
+     */
+    if (!(Doc = malloc(File.Len + sizeof(Edit))))
+    {
+        fprintf(stderr, "%s: Out of memory.\n", Me);
+        return (EXIT_FAILURE);
+    }
+    memcpy(Doc, File.Text, File.Len);
+    Doc[File.Len] = 0;
+    for (Pos = Doc; (Pos = strstr(Pos, "\\input")); Pos++)
+    {
+        if ((Pos == Doc) || (Pos[-1] == '\n'))
+            *Pos = '%';
+    }
+
+    /* Edit goes in at the start of the line halfway through */
+    Middle = File.Len / 2;
+    while (Middle && (Doc[Middle - 1] != '\n'))
+        Middle--;
+
+    Session = ChkTeXNewSession();
+    RecheckDoc(&Got, Session, Name, Doc, File.Len);
+    CheckDoc(&Plain, Name, Doc, File.Len);
+    Compare("ChkTeXRecheck()", &Got, &Plain);
+
+    memmove(&Doc[Middle + strlen(Edit)], &Doc[Middle], File.Len - Middle);
+    memcpy(&Doc[Middle], Edit, strlen(Edit));
+    RecheckDoc(&Got, Session, Name, Doc, File.Len + strlen(Edit));
+    CheckDoc(&Full, Name, Doc, File.Len + strlen(Edit));
+    Compare("ChkTeXRecheck() after an edit", &Got, &Full);
+
+    memmove(&Doc[Middle], &Doc[Middle + strlen(Edit)], File.Len - Middle);
+    RecheckDoc(&Got, Session, Name, Doc, File.Len);
+    Compare("ChkTeXRecheck() after undoing an edit", &Got, &Plain);
+
+    ChkTeXFreeSession(Session);
+    free(Doc);
+    free(File.Text);
+    free(Full.Text);
+    free(Plain.Text);
+    free(Got.Text);
+
+    return (Failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
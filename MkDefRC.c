@@ -0,0 +1,53 @@
+/*
+ *  ChkTeX, writes the built-in configuration.
+ *  Copyright (C) 1995-96 Jens T. Berger Thielemann
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Contact the author at:
+ *              Jens Berger
+ *              Spektrumvn. 4
+ *              N-0666 Oslo
+ *              Norway
+ *              E-mail: <jensthi@ifi.uio.no>
+ *
+ *
+ */
+
+
+#include "ChkTeX.h"
+#include "Utility.h"
+#include "Resource.h"
+
+/*
+ * mkdefrc is linked with everything but DefaultRC.o, which it makes;
+ * having no built-in configuration itself, it reads the resource file
+ * the slow way. See WriteDefaultRC().
+ */
+
+const struct DefaultRC DefaultRC = { 0, 0, NULL, 0 };
+
+int main(int argc, char **argv)
+{
+    PrgName = argv[0];
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s chktexrc DefaultRC.c\n", PrgName);
+        return (EXIT_FAILURE);
+    }
+
+    return (WriteDefaultRC(argv[1], argv[2]) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
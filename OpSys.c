@@ -47,6 +47,12 @@
 #ifdef HAVE_STAT_H
 #  include <stat.h>
 #endif
+#ifdef HAVE_FCNTL_H
+#  include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#  include <sys/mman.h>
+#endif
 
 #if HAVE_DIRENT_H
 #  include <dirent.h>
@@ -73,6 +79,19 @@
 #  define USE_RECURSE 0
 #endif
 
+#if defined(HAVE_MMAP) && defined(HAVE_MUNMAP) && defined(HAVE_SYS_MMAN_H) && \
+    defined(HAVE_FCNTL_H) && defined(HAVE_SYS_STAT_H) && defined(HAVE_UNISTD_H)
+#  define USE_MMAP 1
+#else
+#  define USE_MMAP 0
+#endif
+
+/* Where available, writable mappings are faulted in at once; they're
+ * likely to be written to all over (see LoadCompiled()). */
+#ifndef MAP_POPULATE
+#  define MAP_POPULATE 0
+#endif
+
 #if defined(HAVE_LIBTERMCAP) || defined(HAVE_LIBTERMLIB)
 #  define USE_TERMCAP 1
 #endif
@@ -116,11 +135,21 @@ static char term_buffer[2048];
 #endif
 
 char ConfigFile[BUFSIZ] = LOCALRCFILE;
+
+/*
+ * Set this to have MapFile() read files instead of mapping them. A
+ * mapped file which some other program truncates while we're at it
+ * kills us with SIGBUS; this matters when files are kept open for a
+ * while, as with -j and --serve.
+ */
+int NoMapping = FALSE;
 const char *ReverseOn;
 const char *ReverseOff;
 
 
 static int HasFile(char *Dir, const char *Filename, const char *App);
+static const char *MapFileProt(const char *Filename, unsigned long *Size,
+                               int *Mapped, int Writable);
 
 #if USE_RECURSE
 static int SearchFile(char *Dir, const char *Filename, const char *App);
@@ -490,3 +519,227 @@ static int SearchFile(char *Dir, const char *Filename, const char *App)
     return (Found);
 }
 #endif /* USE_RECURSE */
+
+/*  -=><=- -=><=- -=><=- -=><=- -=><=- -=><=- -=><=- -=><=- -=><=-  */
+
+/*
+ * Reads everything remaining in `fh' into a malloc()'ed buffer. The
+ * buffer is NUL terminated, but may contain other NUL's as well; use
+ * the size returned in `Size'. Returns NULL if we ran out of memory or
+ * got a read error.
+ */
+
+char *SlurpFile(FILE *fh, unsigned long *Size)
+{
+    char *Data = NULL, *NewData;
+    size_t Used = 0, Alloc = 0, Got;
+
+    do
+    {
+        if (Alloc - Used < BUFSIZ)
+        {
+            Alloc = Alloc ? (Alloc << 1) : (BUFSIZ << 2);
+            if (!(NewData = saferealloc(Data, Alloc + 1)))
+            {
+                free(Data);
+                return (NULL);
+            }
+            Data = NewData;
+        }
+        Got = fread(&Data[Used], 1, Alloc - Used, fh);
+        Used += Got;
+    }
+    while (Got);
+
+    if (ferror(fh))
+    {
+        free(Data);
+        return (NULL);
+    }
+
+    Data[Used] = 0;
+    *Size = Used;
+    return (Data);
+}
+
+/*
+ * Makes the whole contents of the file `Filename' available in memory,
+ * by mapping it where the system allows it and by reading it
+ * otherwise. Either way, the file itself is closed before we return,
+ * so that nested \input files don't eat file descriptors. `*Mapped'
+ * tells UnmapFile() how to release the memory later on.
+ *
+ * The memory is *not* NUL terminated; use `*Size'.
+ */
+
+const char *MapFile(const char *Filename, unsigned long *Size, int *Mapped)
+{
+    return (MapFileProt(Filename, Size, Mapped, FALSE));
+}
+
+/*
+ * Same as MapFile(), but the memory may be written to; the changes
+ * are private, and never reach the file.
+ */
+
+char *MapFileWritable(const char *Filename, unsigned long *Size, int *Mapped)
+{
+    return ((char *) MapFileProt(Filename, Size, Mapped, TRUE));
+}
+
+/*
+ * Does the work for the two above.
+ */
+
+static const char *MapFileProt(const char *Filename, unsigned long *Size,
+                               int *Mapped, int Writable)
+{
+    const char *Data = NULL;
+    FILE *fh;
+
+#if USE_MMAP
+    struct stat statbuf;
+    void *Addr;
+    int fd;
+
+    if (!NoMapping && ((fd = open(Filename, O_RDONLY)) >= 0))
+    {
+        /* Empty files can't be mapped; they're read below instead. */
+        if (!fstat(fd, &statbuf) && ((statbuf.st_mode & S_IFMT) == S_IFREG)
+            && (statbuf.st_size > 0))
+        {
+            Addr = mmap(NULL, (size_t) statbuf.st_size,
+                        Writable ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                        MAP_PRIVATE | (Writable ? MAP_POPULATE : 0), fd, 0);
+            if (Addr != MAP_FAILED)
+            {
+                close(fd);
+                *Size = (unsigned long) statbuf.st_size;
+                *Mapped = TRUE;
+                return ((const char *) Addr);
+            }
+        }
+        close(fd);
+    }
+#endif /* USE_MMAP */
+
+    /* Pipes, devices and systems without mmap() end up here. */
+    if ((fh = fopen(Filename, "r")))
+    {
+        Data = SlurpFile(fh, Size);
+        fclose(fh);
+        *Mapped = FALSE;
+    }
+
+    return (Data);
+}
+
+/*
+ * Releases memory obtained through MapFile() or SlurpFile().
+ */
+
+void UnmapFile(const char *Data, unsigned long Size, int Mapped)
+{
+    if (Mapped)
+    {
+#if USE_MMAP
+        munmap((void *) Data, (size_t) Size);
+#endif
+    }
+    else if (Data)
+        free((void *) Data);
+}
+
+/*
+ * Size of the file `Filename' in bytes, or 0 if we can't tell.
+ */
+
+unsigned long FileSize(const char *Filename)
+{
+#if defined(HAVE_STAT) && (defined(HAVE_SYS_STAT_H) || defined(HAVE_STAT_H))
+    struct stat statbuf;
+
+    if (!stat(Filename, &statbuf) && (statbuf.st_size > 0))
+        return ((unsigned long) statbuf.st_size);
+#endif
+    return (0L);
+}
+
+/*
+ * Opens a stream whose output is held back until DrainSpool() copies
+ * it somewhere else. It lives in memory where the system allows it,
+ * and in a temporary file otherwise.
+ */
+
+int OpenSpool(struct Spool *sp)
+{
+    sp->Data = NULL;
+    sp->Size = 0;
+#ifdef HAVE_OPEN_MEMSTREAM
+    sp->fh = open_memstream(&sp->Data, &sp->Size);
+#else
+    sp->fh = tmpfile();
+#endif
+    return (sp->fh != NULL);
+}
+
+/*
+ * Copies everything written to the spool so far to `Dest'; the spool
+ * stays open.
+ */
+
+void CopySpool(struct Spool *sp, FILE *Dest)
+{
+#ifndef HAVE_OPEN_MEMSTREAM
+    char Buf[BUFSIZ];
+    size_t Got;
+#endif
+
+    if (!sp->fh)
+        return;
+
+    fflush(sp->fh);
+#ifdef HAVE_OPEN_MEMSTREAM
+    if (sp->Size)
+        fwrite(sp->Data, 1, sp->Size, Dest);
+#else
+    rewind(sp->fh);
+    while ((Got = fread(Buf, 1, sizeof(Buf), sp->fh)))
+        fwrite(Buf, 1, Got, Dest);
+    fseek(sp->fh, 0L, SEEK_END);
+#endif
+}
+
+/*
+ * Closes the spool, copying everything written to it to `Dest' (unless
+ * that is NULL).
+ */
+
+void DrainSpool(struct Spool *sp, FILE *Dest)
+{
+#ifndef HAVE_OPEN_MEMSTREAM
+    char Buf[BUFSIZ];
+    size_t Got;
+#endif
+
+    if (!sp->fh)
+        return;
+
+#ifdef HAVE_OPEN_MEMSTREAM
+    fclose(sp->fh);
+    if (Dest && sp->Size)
+        fwrite(sp->Data, 1, sp->Size, Dest);
+    free(sp->Data);
+#else
+    if (Dest)
+    {
+        rewind(sp->fh);
+        while ((Got = fread(Buf, 1, sizeof(Buf), sp->fh)))
+            fwrite(Buf, 1, Got, Dest);
+    }
+    fclose(sp->fh);
+#endif
+    sp->fh = NULL;
+    sp->Data = NULL;
+    sp->Size = 0;
+}
@@ -182,12 +182,34 @@
 #  define BAKAPPENDIX ".bak"
 #endif
 
+/*  -=><=- -=><=- -=><=- -=><=- -=><=- -=><=- -=><=- -=><=- -=><=-  */
+
+/*
+ * Threads are used for checking several files at the same time (-j);
+ * without them, we simply check one file after another.
+ */
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE)
+#  include <pthread.h>
+#  define USE_THREADS 1
+#else
+#  define USE_THREADS 0
+#endif
+
 /***************** END OF USER SETTABLE PREFERENCES *****************/
 /********************************************************************/
 
 #ifndef WORDLIST_DEFINED
 struct WordList;
 #endif
+
+/* Output held back until it can be written in order; see OpenSpool() */
+struct Spool
+{
+    FILE *fh;
+    char *Data;
+    size_t Size;
+};
 /* Sorry; there are now cyclic dependencies in the
 * source tree. :-/ 
 */
@@ -195,6 +217,7 @@ struct WordList;
 extern const char *ReverseOn;
 extern const char *ReverseOff;
 extern char ConfigFile[BUFSIZ];
+extern int NoMapping;
 
 char *MatchFileName(char *String);
 int SetupVars(void);
@@ -203,5 +226,13 @@ void AddAppendix(char *Name, const char *App);
 void tackon(char *, const char *);
 int LocateFile(const char *Filename, char *Dest, const char *App,
                struct WordList *wl);
+char *SlurpFile(FILE *fh, unsigned long *Size);
+const char *MapFile(const char *Filename, unsigned long *Size, int *Mapped);
+char *MapFileWritable(const char *Filename, unsigned long *Size, int *Mapped);
+void UnmapFile(const char *Data, unsigned long Size, int Mapped);
+unsigned long FileSize(const char *Filename);
+int OpenSpool(struct Spool *sp);
+void CopySpool(struct Spool *sp, FILE *Dest);
+void DrainSpool(struct Spool *sp, FILE *Dest);
 
 #endif /* OPSYS_H */
@@ -0,0 +1,640 @@
+/*
+ *  ChkTeX, incremental re-checking.
+ *  Copyright (C) 1995-96 Jens T. Berger Thielemann
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Contact the author at:
+ *              Jens Berger
+ *              Spektrumvn. 4
+ *              N-0666 Oslo
+ *              Norway
+ *              E-mail: <jensthi@ifi.uio.no>
+ *
+ *
+ */
+
+/*
+ * When a document is checked again after a small change, most of it
+ * will give exactly the same results as last time. All FindErr()
+ * carries from one line to the next is the state below, so we save a
+ * checkpoint of it in front of every line. The next time, we start at
+ * the first line which changed, from the checkpoint in front of it.
+ * Once we're past the change and the state is the same as it was in
+ * front of the same line last time, the rest of the document can't
+ * give anything new; we just hand out the old results, moved by the
+ * number of lines added or removed.
+ *
+ * Documents which \input other files are always checked in full, as
+ * those files may have changed behind our back.
+ */
+
+#include "ChkTeX.h"
+#include "FindErrs.h"
+#include "Utility.h"
+#include "Recheck.h"
+#include <string.h>
+
+/*
+ * An entry of CharStack or EnvStack, as saved in a checkpoint. Most
+ * entries stay on the stack for many lines, so the checkpoints share
+ * them. The line is shared with the entry itself.
+ */
+
+struct SavedErr
+{
+    unsigned long Refs;
+    unsigned long Run;          /* Last run which renumbered it */
+    char *Data;
+    struct LineRef *LineRef;
+    unsigned long Line, Column, ErrLen;
+    int Flags;
+};
+
+/*
+ * The state FindErr() carries into a line. Keep in step with
+ * STATE_VARS and struct CheckState.
+ */
+
+struct Checkpoint
+{
+#define DEF(type, name, value) type name
+    STATE_VARS;
+#undef DEF
+
+    unsigned long Brackets[NUMBRACKETS];
+    int LastWasComment, SeenSpace;
+    int ItFlag, MathFlag;
+
+    struct SavedErr **Saved;    /* CharStack, then EnvStack */
+    unsigned long NumChars, NumEnvs;
+
+    unsigned long NumDiags;     /* # diagnostics in front of the line */
+};
+
+struct SavedDiag
+{
+    unsigned long Line;
+    long Column, Length;
+    int Number;
+    enum ChkTeXKind Kind;
+    char *Message;
+};
+
+struct ChkTeXSession
+{
+    char *Name;                 /* Last document checked */
+    char *Data;
+    unsigned long Size;
+
+    unsigned long *Lines;       /* Offset of each line, then Size */
+    unsigned long NumLines;
+
+    struct Checkpoint *Checks;  /* In front of each line, and at the end */
+
+    struct SavedDiag *Diags;
+    unsigned long NumDiags, MaxDiags;
+
+    unsigned long ErrPrint, WarnPrint;
+    unsigned long Run;
+    int Valid;                  /* Whether the checkpoints may be used */
+
+    ChkTeXReport Report;        /* Of the current run */
+    void *UserData;
+};
+
+struct ChkTeXSession *NewSession(void)
+{
+    struct ChkTeXSession *s;
+
+    if (!(s = calloc(1, sizeof(struct ChkTeXSession))))
+        PrintPrgErr(pmNoStackMem);
+
+    return (s);
+}
+
+/*
+ * Finds where each line of `Data' starts; lines are split as
+ * FGetsStk() does.
+ */
+
+static unsigned long *FindLines(const char *Data, unsigned long Size,
+                                unsigned long *NumLines)
+{
+    unsigned long *Lines, Num = 0, Max = MINPUDDLE, Pos = 0;
+    const char *NewLine;
+
+    if (!(Lines = malloc(Max * sizeof(unsigned long))))
+        PrintPrgErr(pmNoStackMem);
+
+    for (;;)
+    {
+        if (Num == Max)
+        {
+            Max *= 2;
+            if (!(Lines = realloc(Lines, Max * sizeof(unsigned long))))
+                PrintPrgErr(pmNoStackMem);
+        }
+
+        Lines[Num] = Pos;
+        if (Pos >= Size)
+            break;
+
+        Num++;
+        if ((NewLine = memchr(&Data[Pos], '\n', Size - Pos)))
+            Pos = NewLine - Data + 1;
+        else
+            Pos = Size;
+    }
+
+    *NumLines = Num;
+    return (Lines);
+}
+
+static int SameLine(const char *Data1, const unsigned long *Lines1,
+                    unsigned long Line1, const char *Data2,
+                    const unsigned long *Lines2, unsigned long Line2)
+{
+    unsigned long Len = Lines1[Line1 + 1] - Lines1[Line1];
+
+    return ((Len == Lines2[Line2 + 1] - Lines2[Line2]) &&
+            !memcmp(&Data1[Lines1[Line1]], &Data2[Lines2[Line2]], Len));
+}
+
+static void DropSaved(struct SavedErr *se)
+{
+    if (!--se->Refs)
+    {
+        free(se->Data);
+        DropLine(se->LineRef);
+        free(se);
+    }
+}
+
+static void ClearCheckpoint(struct Checkpoint *ck)
+{
+    unsigned long i;
+
+    for (i = 0; i < ck->NumChars + ck->NumEnvs; i++)
+        DropSaved(ck->Saved[i]);
+    free(ck->Saved);
+    if (ck->VerbMode)
+        free((void *) ck->VerbStr);
+
+    memset(ck, 0, sizeof(struct Checkpoint));
+}
+
+/*
+ * Whether `se' is `ei', given that `se' should be on line `Line' now.
+ */
+
+static int SameErr(const struct SavedErr *se, unsigned long Line,
+                   const struct ErrInfo *ei)
+{
+    return ((Line == ei->Line) && (se->Column == ei->Column) &&
+            (se->ErrLen == ei->ErrLen) && (se->Flags == (int) ei->Flags) &&
+            !strcmp(se->Data, ei->Data) &&
+            ((se->LineRef == ei->LineRef) ||
+             !strcmp(se->LineRef->Text, ei->LineRef->Text)));
+}
+
+static struct SavedErr *SaveErr(const struct ErrInfo *ei,
+                                struct SavedErr *Prev)
+{
+    struct SavedErr *se;
+
+    if (Prev && SameErr(Prev, Prev->Line, ei))
+        se = Prev;
+    else if ((se = calloc(1, sizeof(struct SavedErr))) &&
+             (se->Data = strdup(ei->Data)))
+    {
+        se->LineRef = ei->LineRef;
+        se->LineRef->Refs++;
+        se->Line = ei->Line;
+        se->Column = ei->Column;
+        se->ErrLen = ei->ErrLen;
+        se->Flags = ei->Flags;
+    }
+    else
+        PrintPrgErr(pmStrDupErr);
+
+    se->Refs++;
+    return (se);
+}
+
+/*
+ * Saves the state of `cs' in `ck', sharing what it can with `Prev',
+ * the checkpoint of the previous line (if any).
+ */
+
+static void SaveState(struct ChkTeXSession *s, struct CheckState *cs,
+                      struct Checkpoint *ck, const struct Checkpoint *Prev)
+{
+    unsigned long i, Num;
+
+#define DEF(type, name, value) ck->name = cs->name
+    STATE_VARS;
+#undef DEF
+    /* cs->VerbStr may point into cs->VBStr */
+    if (!ck->VerbMode)
+        ck->VerbStr = "";
+    else if (!(ck->VerbStr = strdup(cs->VerbStr)))
+        PrintPrgErr(pmStrDupErr);
+
+    memcpy(ck->Brackets, cs->Brackets, sizeof(ck->Brackets));
+    ck->LastWasComment = cs->LastWasComment;
+    ck->SeenSpace = cs->SeenSpace;
+    ck->ItFlag = cs->ItFlag;
+    ck->MathFlag = cs->MathFlag;
+    ck->NumDiags = s->NumDiags;
+
+    ck->NumChars = cs->CharStack.Used;
+    ck->NumEnvs = cs->EnvStack.Used;
+    if ((Num = ck->NumChars + ck->NumEnvs))
+    {
+        if (!(ck->Saved = malloc(Num * sizeof(struct SavedErr *))))
+            PrintPrgErr(pmNoStackMem);
+
+        for (i = 0; i < ck->NumChars; i++)
+            ck->Saved[i] = SaveErr(&cs->CharStack.Data[i],
+                                   (Prev && (i < Prev->NumChars)) ?
+                                   Prev->Saved[i] : NULL);
+        for (i = 0; i < ck->NumEnvs; i++)
+            ck->Saved[ck->NumChars + i] =
+                SaveErr(&cs->EnvStack.Data[i],
+                        (Prev && (i < Prev->NumEnvs)) ?
+                        Prev->Saved[Prev->NumChars + i] : NULL);
+    }
+}
+
+/*
+ * Puts `cs' (just created) in the state saved in `ck'.
+ */
+
+static void LoadState(struct CheckState *cs, const struct Checkpoint *ck)
+{
+    struct ErrInfo *ei;
+    struct SavedErr *se;
+    unsigned long i;
+
+#define DEF(type, name, value) cs->name = ck->name
+    STATE_VARS;
+#undef DEF
+    if (cs->VerbMode)
+    {
+        GROWBUF(cs->VBStr, strlen(ck->VerbStr) + 1);
+        strcpy(cs->VBStr, ck->VerbStr);
+        cs->VerbStr = cs->VBStr;
+    }
+
+    memcpy(cs->Brackets, ck->Brackets, sizeof(cs->Brackets));
+    cs->LastWasComment = ck->LastWasComment;
+    cs->SeenSpace = ck->SeenSpace;
+    cs->ItFlag = ck->ItFlag;
+    cs->MathFlag = ck->MathFlag;
+
+    for (i = 0; i < ck->NumChars + ck->NumEnvs; i++)
+    {
+        se = ck->Saved[i];
+        if (!(ei = PushErr(CurStkName(cs), se->Data, se->Line, se->Column,
+                           se->ErrLen, se->LineRef,
+                           (i < ck->NumChars) ?
+                           &cs->CharStack : &cs->EnvStack)))
+            PrintPrgErr(pmNoStackMem);
+        ei->Flags = se->Flags;
+    }
+}
+
+/*
+ * Line `Line' of last time's document, in this one. Lines up to
+ * `Prefix' are unchanged, those after `OldEnd' have moved by `Delta';
+ * the others are gone (0).
+ */
+
+static unsigned long MoveLine(unsigned long Line, unsigned long Prefix,
+                              unsigned long OldEnd, long Delta)
+{
+    if (Line <= Prefix)
+        return (Line);
+    else if (Line > OldEnd)
+        return (Line + Delta);
+    else
+        return (0);
+}
+
+/*
+ * Whether `cs' is in the state saved in `ck' last time. The counts
+ * don't matter.
+ */
+
+static int Converged(struct CheckState *cs, const struct Checkpoint *ck,
+                     unsigned long Prefix, unsigned long OldEnd, long Delta)
+{
+    unsigned long i;
+    struct SavedErr *se;
+
+    if ((cs->ItState != ck->ItState) || (cs->AtLetter != ck->AtLetter) ||
+        (cs->InHeader != ck->InHeader) || (cs->VerbMode != ck->VerbMode) ||
+        (cs->MathMode != ck->MathMode) ||
+        (cs->FileSuppressions != ck->FileSuppressions) ||
+        (cs->UserFileSuppressions != ck->UserFileSuppressions) ||
+        (cs->VerbMode && strcmp(cs->VerbStr, ck->VerbStr)) ||
+        memcmp(cs->Brackets, ck->Brackets, sizeof(cs->Brackets)) ||
+        (cs->LastWasComment != ck->LastWasComment) ||
+        (cs->SeenSpace != ck->SeenSpace) ||
+        (cs->ItFlag != ck->ItFlag) || (cs->MathFlag != ck->MathFlag) ||
+        (cs->CharStack.Used != ck->NumChars) ||
+        (cs->EnvStack.Used != ck->NumEnvs))
+        return (FALSE);
+
+    for (i = 0; i < ck->NumChars + ck->NumEnvs; i++)
+    {
+        se = ck->Saved[i];
+        if (!SameErr(se, MoveLine(se->Line, Prefix, OldEnd, Delta),
+                     (i < ck->NumChars) ? &cs->CharStack.Data[i] :
+                     &cs->EnvStack.Data[i - ck->NumChars]))
+            return (FALSE);
+    }
+
+    return (TRUE);
+}
+
+/*
+ * Adds `sd' (which we take over) to the diagnostics of `s', and
+ * reports it.
+ */
+
+static void AddDiag(struct ChkTeXSession *s, const struct SavedDiag *sd,
+                    const char *File)
+{
+    struct ChkTeXDiag Diag;
+
+    if (s->NumDiags == s->MaxDiags)
+    {
+        s->MaxDiags = s->MaxDiags ? s->MaxDiags * 2 : MINPUDDLE;
+        if (!(s->Diags = realloc(s->Diags,
+                                 s->MaxDiags * sizeof(struct SavedDiag))))
+            PrintPrgErr(pmNoStackMem);
+    }
+    s->Diags[s->NumDiags++] = *sd;
+
+    Diag.File = File;
+    Diag.Line = sd->Line;
+    Diag.Column = sd->Column;
+    Diag.Length = sd->Length;
+    Diag.Number = sd->Number;
+    Diag.Kind = sd->Kind;
+    Diag.Message = sd->Message;
+    s->Report(&Diag, s->UserData);
+}
+
+/*
+ * Takes the diagnostics of the run, see struct CheckState.
+ */
+
+static void SessionReport(const struct ChkTeXDiag *Diag, void *UserData)
+{
+    struct ChkTeXSession *s = UserData;
+    struct SavedDiag sd;
+
+    sd.Line = Diag->Line;
+    sd.Column = Diag->Column;
+    sd.Length = Diag->Length;
+    sd.Number = Diag->Number;
+    sd.Kind = Diag->Kind;
+    if (!(sd.Message = strdup(Diag->Message)))
+        PrintPrgErr(pmStrDupErr);
+
+    AddDiag(s, &sd, Diag->File);
+}
+
+/*
+ * Checks `Data' as the document `Name', reusing what we can from the
+ * last time `s' was used. Reports exactly what a full check would,
+ * and returns the number of errors and warnings, or -1 if we couldn't
+ * check the document at all.
+ */
+
+int Recheck(struct ChkTeXSession *s, const char *Name, const char *Data,
+            unsigned long Size, ChkTeXReport Report, void *UserData)
+{
+    struct CheckState *cs;
+    struct FileNode *fn;
+    struct Checkpoint *Checks, *Old = s->Checks, Base;
+    struct SavedDiag *OldDiags = s->Diags, *sd;
+    struct SavedErr *se;
+    unsigned long *Lines, NumLines, OldLines = s->NumLines;
+    unsigned long Prefix = 0, Suffix = 0, OldEnd, OldNumDiags = s->NumDiags;
+    unsigned long i, j, k, Len, Kept = 0, At = 0;
+    const char *Line;
+    char *Copy;
+    long Delta;
+    int Reuse, Nested = FALSE, Conv = FALSE;
+
+    if (!(cs = NewCheckState(NULL)))
+        return (-1);
+
+    cs->StatusFile = NULL;
+    cs->Report = SessionReport;
+    cs->ReportData = s;
+
+    if (!PushBuffer(Name, Data, Size, &cs->InputStack) ||
+        !(Copy = malloc(Size + 1)))
+    {
+        FreeCheckState(cs);
+        return (-1);
+    }
+    memcpy(Copy, Data, Size);
+    Copy[Size] = 0;
+
+    fn = StkTop(&cs->InputStack);
+    Lines = FindLines(Data, Size, &NumLines);
+    if (!(Checks = calloc(NumLines + 1, sizeof(struct Checkpoint))))
+        PrintPrgErr(pmNoStackMem);
+
+    /* Find the lines which changed since last time */
+    if ((Reuse = s->Valid && !strcmp(s->Name, Name)))
+    {
+        while ((Prefix < min(NumLines, OldLines)) &&
+               SameLine(Data, Lines, Prefix, s->Data, s->Lines, Prefix))
+            Prefix++;
+        while ((Suffix < min(NumLines, OldLines) - Prefix) &&
+               SameLine(Data, Lines, NumLines - Suffix - 1,
+                        s->Data, s->Lines, OldLines - Suffix - 1))
+            Suffix++;
+    }
+    OldEnd = OldLines - Suffix;
+    Delta = (long) NumLines - (long) OldLines;
+
+    s->Report = Report;
+    s->UserData = UserData;
+    s->Run++;
+    s->Diags = NULL;
+    s->NumDiags = s->MaxDiags = 0;
+
+    /* Everything in front of the change stays as it was */
+    if (Reuse)
+    {
+        Kept = Old[Prefix].NumDiags;
+        for (i = 0; i < Kept; i++)
+            AddDiag(s, &OldDiags[i], CurStkName(cs));
+        for (i = 0; i < Prefix; i++)
+        {
+            Checks[i] = Old[i];
+            memset(&Old[i], 0, sizeof(struct Checkpoint));
+        }
+
+        /*
+         * Old[Prefix] stays where it is: after an insertion, it is the
+         * first one we may converge on. Checks[Prefix] is saved anew.
+         */
+        LoadState(cs, &Old[Prefix]);
+        /* As if we had read the lines in front of the change */
+        fn->Pos = Lines[Prefix];
+        fn->Line = cs->LastLine = Prefix;
+    }
+
+    while ((Line = FGetsStk(cs, &Len)))
+    {
+        if (cs->InputStack.Used == 1)
+        {
+            i = fn->Line - 1;
+            if (Reuse && (i >= NumLines - Suffix) &&
+                Converged(cs, &Old[OldLines - (NumLines - i)], Prefix,
+                          OldEnd, Delta))
+            {
+                At = i;
+                Conv = TRUE;
+                break;
+            }
+
+            ClearCheckpoint(&Checks[i]);
+            SaveState(s, cs, &Checks[i], i ? &Checks[i - 1] : NULL);
+        }
+        else
+            Nested = TRUE;
+
+        FindErr(cs, Line, Len, CurStkLine(cs));
+    }
+
+    if (Conv)
+    {
+        /* The rest comes out as last time, only moved by Delta lines */
+        j = OldLines - (NumLines - At);
+        Base = Old[j];
+
+        for (i = At; i <= NumLines; i++, j++)
+        {
+            ClearCheckpoint(&Checks[i]);
+            Checks[i] = Old[j];
+            memset(&Old[j], 0, sizeof(struct Checkpoint));
+
+#define MOVE(name) Checks[i].name += cs->name - Base.name
+            MOVE(ErrPrint);
+            MOVE(WarnPrint);
+            MOVE(UserSupp);
+            MOVE(LineSupp);
+#undef MOVE
+            Checks[i].NumDiags += s->NumDiags - Base.NumDiags;
+
+            for (k = 0; Delta && (k < Checks[i].NumChars +
+                                  Checks[i].NumEnvs); k++)
+            {
+                se = Checks[i].Saved[k];
+                if (se->Run != s->Run)
+                {
+                    se->Line = MoveLine(se->Line, Prefix, OldEnd, Delta);
+                    se->Run = s->Run;
+                }
+            }
+        }
+
+        for (i = Base.NumDiags; i < OldNumDiags; i++)
+        {
+            sd = &OldDiags[i];
+            sd->Line = MoveLine(sd->Line, Prefix, OldEnd, Delta);
+            AddDiag(s, sd, CurStkName(cs));
+            sd->Message = NULL;
+        }
+
+        s->ErrPrint += cs->ErrPrint - Base.ErrPrint;
+        s->WarnPrint += cs->WarnPrint - Base.WarnPrint;
+    }
+    else
+    {
+        ClearCheckpoint(&Checks[NumLines]);
+        SaveState(s, cs, &Checks[NumLines], NumLines ?
+                  &Checks[NumLines - 1] : NULL);
+        PrintStatus(cs, CurStkLine(cs));
+
+        s->ErrPrint = cs->ErrPrint;
+        s->WarnPrint = cs->WarnPrint;
+    }
+
+    /* Throw away what we didn't reuse */
+    for (i = Kept; i < OldNumDiags; i++)
+        free(OldDiags[i].Message);
+    free(OldDiags);
+
+    for (i = 0; Old && (i <= OldLines); i++)
+        ClearCheckpoint(&Old[i]);
+    free(Old);
+
+    if (!Reuse || strcmp(s->Name, Name))
+    {
+        free(s->Name);
+        if (!(s->Name = strdup(Name)))
+            PrintPrgErr(pmStrDupErr);
+    }
+    free(s->Data);
+    free(s->Lines);
+    s->Data = Copy;
+    s->Size = Size;
+    s->Lines = Lines;
+    s->NumLines = NumLines;
+    s->Checks = Checks;
+    s->Valid = !Nested;
+
+    FreeCheckState(cs);
+    return ((int) (s->ErrPrint + s->WarnPrint));
+}
+
+void SessionCounts(const struct ChkTeXSession *s, unsigned long *Errors,
+                   unsigned long *Warnings)
+{
+    *Errors = s->ErrPrint;
+    *Warnings = s->WarnPrint;
+}
+
+void FreeSession(struct ChkTeXSession *s)
+{
+    unsigned long i;
+
+    if (s)
+    {
+        for (i = 0; i < s->NumDiags; i++)
+            free(s->Diags[i].Message);
+        free(s->Diags);
+
+        for (i = 0; s->Checks && (i <= s->NumLines); i++)
+            ClearCheckpoint(&s->Checks[i]);
+        free(s->Checks);
+
+        free(s->Name);
+        free(s->Data);
+        free(s->Lines);
+        free(s);
+    }
+}
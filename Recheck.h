@@ -0,0 +1,46 @@
+/*
+ *  ChkTeX, incremental re-checking -- header file.
+ *  Copyright (C) 1995-96 Jens T. Berger Thielemann
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Contact the author at:
+ *              Jens Berger
+ *              Spektrumvn. 4
+ *              N-0666 Oslo
+ *              Norway
+ *              E-mail: <jensthi@ifi.uio.no>
+ *
+ *
+ */
+
+#ifndef RECHECK_H
+#define RECHECK_H 1
+
+#include "ChkTeX.h"
+
+/*
+ * A document which is checked again and again as it is edited; see
+ * Recheck.c. The public side of this is ChkTeXRecheck().
+ */
+
+struct ChkTeXSession *NewSession(void);
+void FreeSession(struct ChkTeXSession *s);
+int Recheck(struct ChkTeXSession *s, const char *Name, const char *Data,
+            unsigned long Size, ChkTeXReport Report, void *UserData);
+void SessionCounts(const struct ChkTeXSession *s, unsigned long *Errors,
+                   unsigned long *Warnings);
+
+#endif /* RECHECK_H */
@@ -41,21 +41,25 @@ RESOURCE_INFO
 #undef LCASE
 #undef LNEMPTY
 #undef LIST
+
+struct Arena ConfigArena;
+
 struct KeyWord
 {
     const char *Name;
     const char **String;        /* Keyword = item */
     struct WordList *List,      /* Case-sensitive strings */
      *CaseList;                 /* Case-insensitive strings */
+    const char *Default;        /* Of String */
 };
 
 #define LNEMPTY LIST
-#define LIST(name)       {#name, NULL, &name, NULL},
-#define LCASE(name)      {#name, NULL, &name, &name ## Case},
-#define KEY(name,def)    {#name, &name, NULL, NULL},
+#define LIST(name)       {#name, NULL, &name, NULL, NULL},
+#define LCASE(name)      {#name, NULL, &name, &name ## Case, NULL},
+#define KEY(name,def)    {#name, &name, NULL, NULL, def},
 
 struct KeyWord Keys[] = {
-    RESOURCE_INFO {NULL, NULL, NULL, NULL}
+    RESOURCE_INFO {NULL, NULL, NULL, NULL, NULL}
 };
 
 #undef KEY
@@ -92,6 +96,7 @@ static unsigned long RsrcLine;
 
 static enum Token ReadWord(char *, FILE *);
 static char MapChars(char **String);
+static int UseDefaultRC(const char *Filename);
 
 
 
@@ -128,6 +133,15 @@ int ReadRC(const char *Filename)
     } What = whNone;
 
 
+    if (CompiledConfig)
+    {
+        PrintPrgErr(pmCompiledRC, Filename);
+        return (FALSE);
+    }
+
+    if (UseDefaultRC(Filename))
+        return (TRUE);
+
     RsrcLine = 0;
     Expect = FLG_Word | FLG_Eof;
 
@@ -195,7 +209,9 @@ int ReadRC(const char *Filename)
                 switch (What)
                 {
                 case whEqual:
-                    if (!(*(CurWord->String) = strdup(ReadBuffer)))
+                    if (!(*(CurWord->String) =
+                          ArenaString(&ConfigArena, ReadBuffer,
+                                      strlen(ReadBuffer), 0)))
                     {
                         PrintPrgErr(pmStrDupErr);
                         Token = FLG_Eof;
@@ -512,3 +528,706 @@ static char MapChars(char **String)
     }
     return (Tmp);
 }
+
+/************************ COMPILED CONFIGURATION ************************/
+
+/*
+ * --compile-config saves the lists and keywords, as SetupLists() leaves
+ * them, in a file which --config maps back into memory. The file holds
+ * the words and their hash indexes just as they're laid out in memory,
+ * except that pointers are stored as offsets from the start of the
+ * file; LoadCompiled() turns them back into pointers in place. Loading
+ * thus takes one mmap() and a pass over the pointers, where reading
+ * the resource files takes a couple of allocations per word.
+ *
+ * Since the layout is that of our own structures, a file is only of
+ * use to the chktex which wrote it; ImageHead makes sure of that. It
+ * also holds a hash of the rest, so that a damaged file is refused
+ * rather than half loaded.
+ */
+
+#define IMAGEMAGIC      "ChkTeX compiled config " PACKAGE_VERSION
+#define IMAGEORDER      0x01020304UL    /* Catches other byte orders */
+#define IMAGEALIGN      16
+#define ALIGN(off)      (((off) + IMAGEALIGN - 1) & ~(IMAGEALIGN - 1UL))
+
+/* Stores an offset in a pointer, or back */
+#define OFFPTR(off)     ((void *) (size_t) (off))
+#define PTROFF(ptr)     ((unsigned long) (size_t) (ptr))
+
+struct ImageHead
+{
+    char Magic[48];
+    unsigned long Order, PtrSize, ListSize, SlotSize;
+    unsigned long NumKeys;
+    unsigned long Size;         /* Of the whole file */
+    uint64_t Hash;              /* HashData() of all that follows */
+};
+
+/* One for each entry in Keys[], after the header */
+struct ImageKey
+{
+    struct WordList List, CaseList;
+    char *String;
+};
+
+/* A file being built */
+struct Image
+{
+    char *Data;
+    unsigned long Size, Used;
+};
+
+/* Where a word went, so that the hash index can refer to it */
+struct WordOff
+{
+    const char *Word;
+    unsigned long Off;
+};
+
+const char *CompiledConfig = NULL;
+
+static unsigned long NumKeys(void)
+{
+    unsigned long Cnt;
+
+    for (Cnt = 0; Keys[Cnt].Name; Cnt++)
+        ;
+    return (Cnt);
+}
+
+static void MakeHead(struct ImageHead *Head, const char *Data,
+                     unsigned long Size)
+{
+    memset(Head, 0, sizeof(struct ImageHead));
+    strncpy(Head->Magic, IMAGEMAGIC, sizeof(Head->Magic) - 1);
+    Head->Order = IMAGEORDER;
+    Head->PtrSize = sizeof(void *);
+    Head->ListSize = sizeof(struct WordList);
+    Head->SlotSize = sizeof(struct HashSlot);
+    Head->NumKeys = NumKeys();
+    Head->Size = Size;
+    Head->Hash = HashData(&Data[ALIGN(sizeof(struct ImageHead))],
+                          Size - ALIGN(sizeof(struct ImageHead)));
+}
+
+/*
+ * Appends `Len' bytes of `Data' (or zeros, if it is NULL) to the
+ * image, suitably aligned. Returns the offset they were put at.
+ */
+
+static unsigned long Emit(struct Image *im, const void *Data,
+                          unsigned long Len)
+{
+    unsigned long Off = ALIGN(im->Used), NewSize;
+    char *NewData;
+
+    if (Off + Len > im->Size)
+    {
+        NewSize = max(Off + Len, im->Size << 1);
+        NewSize = max(NewSize, BUFSIZ);
+
+        if (!(NewData = saferealloc(im->Data, NewSize)))
+            PrintPrgErr(pmWordListErr);
+
+        memset(&NewData[im->Size], 0, NewSize - im->Size);
+        im->Data = NewData;
+        im->Size = NewSize;
+    }
+
+    if (Data)
+        memcpy(&im->Data[Off], Data, Len);
+    im->Used = Off + Len;
+
+    return (Off);
+}
+
+/*
+ * Appends the `Len' bytes of `Str', with the padding InsertWord()
+ * gives words.
+ */
+
+static unsigned long EmitString(struct Image *im, const char *Str,
+                                unsigned long Len)
+{
+    unsigned long Off = Emit(im, NULL, Len + WALLBYTES);
+
+    memcpy(&im->Data[Off], Str, Len);
+    return (Off);
+}
+
+/*
+ * Appends a word from a list. ListRep() may have split it in two (as
+ * for WipeArg), so we keep whatever follows the first terminator up
+ * to the second one, too; the padding makes sure there is one.
+ */
+
+static unsigned long EmitWord(struct Image *im, const char *Word)
+{
+    unsigned long Len = strlen(Word) + 1;
+
+    Len += strlen(&Word[Len]) + 1;
+    return (EmitString(im, Word, Len));
+}
+
+static int CmpWordOff(const void *a, const void *b)
+{
+    const char *WordA = ((const struct WordOff *) a)->Word;
+    const char *WordB = ((const struct WordOff *) b)->Word;
+
+    return ((WordA > WordB) - (WordA < WordB));
+}
+
+/*
+ * Appends the words and hash index of `wl', and puts a copy of `wl'
+ * referring to them at `Slot'.
+ */
+
+static int EmitList(struct Image *im, unsigned long Slot,
+                    const struct WordList *wl)
+{
+    struct WordList Out = *wl;
+    struct WordOff *Offs = NULL, *Found, Key;
+    struct HashSlot *hs;
+    unsigned long i, Data, Slots;
+    int Success = TRUE;
+
+    Out.Stack.Data = NULL;
+    Out.Stack.Size = wl->Stack.Used;
+    Out.Hash.Slots = NULL;
+    Out.Mapped = TRUE;
+
+    if (wl->Stack.Used)
+    {
+        if (!(Offs = malloc(wl->Stack.Used * sizeof(struct WordOff))))
+            PrintPrgErr(pmWordListErr);
+
+        Data = Emit(im, NULL, wl->Stack.Used * sizeof(void *));
+        FORWL(i, *wl)
+        {
+            Offs[i].Word = wl->Stack.Data[i];
+            Offs[i].Off = EmitWord(im, Offs[i].Word);
+            ((void **) &im->Data[Data])[i] = OFFPTR(Offs[i].Off);
+        }
+        Out.Stack.Data = OFFPTR(Data);
+        qsort(Offs, wl->Stack.Used, sizeof(struct WordOff), CmpWordOff);
+    }
+
+    if (wl->Hash.Slots)
+    {
+        Slots = Emit(im, wl->Hash.Slots,
+                     wl->Hash.Size * sizeof(struct HashSlot));
+        for (i = 0; Success && (i < wl->Hash.Size); i++)
+        {
+            hs = &((struct HashSlot *) &im->Data[Slots])[i];
+            if (!hs->Str)
+                continue;
+
+            Key.Word = hs->Str;
+            if (!Offs || !(Found = bsearch(&Key, Offs, wl->Stack.Used,
+                                           sizeof(struct WordOff),
+                                           CmpWordOff)))
+                Success = FALSE;
+            else
+                hs->Str = OFFPTR(Found->Off);
+        }
+        Out.Hash.Slots = OFFPTR(Slots);
+    }
+
+    memcpy(&im->Data[Slot], &Out, sizeof(struct WordList));
+    free(Offs);
+    return (Success);
+}
+
+/*
+ * Writes the lists and keywords to `Filename', for --config. Call
+ * SetupLists() first.
+ */
+
+int WriteCompiled(const char *Filename)
+{
+    struct Image im = { NULL, 0, 0 };
+    struct ImageHead Head;
+    unsigned long Cnt, Keys0, Slot, Str;
+    int Success = TRUE;
+    FILE *fh;
+
+    Emit(&im, NULL, sizeof(struct ImageHead));
+    Keys0 = Emit(&im, NULL, NumKeys() * sizeof(struct ImageKey));
+
+    for (Cnt = 0; Success && Keys[Cnt].Name; Cnt++)
+    {
+        Slot = Keys0 + Cnt * sizeof(struct ImageKey);
+        /* Built-in lists have another kind of hash index */
+        if (Keys[Cnt].List)
+        {
+            if (Keys[Cnt].List->Hash.Disp)
+                UnshareWords(Keys[Cnt].List);
+            Success = EmitList(&im, Slot + offsetof(struct ImageKey, List),
+                               Keys[Cnt].List);
+        }
+        if (Keys[Cnt].CaseList && Keys[Cnt].CaseList->Hash.Disp)
+            UnshareWords(Keys[Cnt].CaseList);
+        if (Success && Keys[Cnt].CaseList)
+            Success = EmitList(&im, Slot + offsetof(struct ImageKey, CaseList),
+                               Keys[Cnt].CaseList);
+        if (Keys[Cnt].String && *Keys[Cnt].String)
+        {
+            Str = EmitString(&im, *Keys[Cnt].String,
+                             strlen(*Keys[Cnt].String) + 1);
+            ((struct ImageKey *) &im.Data[Slot])->String = OFFPTR(Str);
+        }
+    }
+
+    /* Any word read up to its terminator stays within the file */
+    Emit(&im, NULL, WALLBYTES);
+
+    MakeHead(&Head, im.Data, im.Used);
+    memcpy(im.Data, &Head, sizeof(struct ImageHead));
+
+    if (!Success)
+        PrintPrgErr(pmAssert);
+    else if (!(fh = fopen(Filename, "wb")) ||
+             (fwrite(im.Data, 1, im.Used, fh) != im.Used) | fclose(fh))
+        PrintPrgErr(pmCompiledWrite, Filename);
+
+    free(im.Data);
+    return (Success);
+}
+
+/*
+ * Turns an offset into `Base' back into a pointer, checking that the
+ * `Len' bytes there are inside the image.
+ */
+
+static void *Reloc(const void *Ptr, unsigned long Len, char *Base,
+                   unsigned long Size, int *Bad)
+{
+    unsigned long Off = PTROFF(Ptr);
+
+    if (!Off)
+        return (NULL);
+
+    if ((Off < sizeof(struct ImageHead)) || (Off > Size) ||
+        (Len > Size - Off))
+    {
+        *Bad = TRUE;
+        return (NULL);
+    }
+    return (Base + Off);
+}
+
+#define RELOC(ptr, len) Reloc(ptr, len, Base, Size, &Bad)
+
+static int LoadList(struct WordList *wl, char *Base, unsigned long Size)
+{
+    struct HashSlot *hs;
+    unsigned long i, Used = 0;
+    int Bad = FALSE;
+
+    if (wl->Stack.Used > Size / sizeof(void *))
+        return (FALSE);
+
+    wl->Stack.Data = RELOC(wl->Stack.Data, wl->Stack.Used * sizeof(void *));
+    if (wl->Stack.Used && !wl->Stack.Data)
+        return (FALSE);
+
+    for (i = 0; !Bad && (i < wl->Stack.Used); i++)
+    {
+        if (!(wl->Stack.Data[i] = RELOC(wl->Stack.Data[i], 1)))
+            Bad = TRUE;
+    }
+
+    /* Lookups rely on the sizes being right, and on a free slot */
+    wl->Hash.Disp = NULL;
+    wl->Hash.Buckets = 0;
+    if ((wl->Hash.Size > Size / sizeof(struct HashSlot)) ||
+        (wl->Hash.Size & (wl->Hash.Size - 1)))
+        return (FALSE);
+
+    wl->Hash.Slots = RELOC(wl->Hash.Slots,
+                           wl->Hash.Size * sizeof(struct HashSlot));
+    if (wl->Hash.Used && !wl->Hash.Slots)
+        return (FALSE);
+
+    for (i = 0; !Bad && wl->Hash.Slots && (i < wl->Hash.Size); i++)
+    {
+        hs = &wl->Hash.Slots[i];
+        if (hs->Str)
+        {
+            if (!(hs->Str = RELOC(hs->Str, 1)) || (strlen(hs->Str) != hs->Len))
+                Bad = TRUE;
+            Used++;
+        }
+        hs->Data = NULL;
+    }
+
+    if ((Used != wl->Hash.Used) || (wl->Hash.Slots && (Used >= wl->Hash.Size)))
+        Bad = TRUE;
+
+    wl->Mapped = TRUE;
+    return (!Bad);
+}
+
+/*
+ * Takes the lists and keywords from `Filename', as written by
+ * WriteCompiled(), instead of reading any resource files. They're
+ * used where they lie, and can't be added to afterwards.
+ */
+
+int LoadCompiled(const char *Filename)
+{
+    struct ImageHead Head, *FileHead;
+    struct ImageKey *ik;
+    unsigned long Size, Cnt, i;
+    char *Base;
+    int Mapped, Bad = FALSE;
+
+    if (!(Base = MapFileWritable(Filename, &Size, &Mapped)))
+        PrintPrgErr(pmCompiledOpen, Filename);
+
+    FileHead = (struct ImageHead *) Base;
+
+    /* The hash catches any change, before we follow the offsets */
+    if (Size < ALIGN(sizeof(struct ImageHead)) + WALLBYTES)
+        Bad = TRUE;
+    else
+    {
+        MakeHead(&Head, Base, Size);
+        if (memcmp(FileHead, &Head, sizeof(struct ImageHead)) ||
+            ((Size - ALIGN(sizeof(struct ImageHead))) /
+             sizeof(struct ImageKey) < Head.NumKeys))
+            Bad = TRUE;
+    }
+
+    for (i = Size - WALLBYTES; !Bad && (i < Size); i++)
+    {
+        if (Base[i])
+            Bad = TRUE;
+    }
+
+    ik = (struct ImageKey *) &Base[ALIGN(sizeof(struct ImageHead))];
+
+    for (Cnt = 0; !Bad && Keys[Cnt].Name; Cnt++, ik++)
+    {
+        if (Keys[Cnt].List)
+        {
+            Bad = !LoadList(&ik->List, Base, Size);
+            *Keys[Cnt].List = ik->List;
+        }
+        if (!Bad && Keys[Cnt].CaseList)
+        {
+            Bad = !LoadList(&ik->CaseList, Base, Size);
+            *Keys[Cnt].CaseList = ik->CaseList;
+        }
+        if (Keys[Cnt].String)
+            *Keys[Cnt].String = RELOC(ik->String, 1);
+    }
+
+    if (Bad)
+        PrintPrgErr(pmCompiledBad, Filename);
+
+    CompiledConfig = Filename;
+    return (TRUE);
+}
+
+/************************ BUILT-IN CONFIGURATION ************************/
+
+/*
+ * Most people use the chktexrc which comes with ChkTeX as it is, so
+ * mkdefrc reads it at build time and writes the lists and keywords it
+ * sets up into DefaultRC.c, with a perfect hash index for each list.
+ * When ReadRC() is asked for that very file, and nothing has been
+ * read yet, it points the lists at those instead of parsing the file.
+ * A list gets words of its own only when it is changed afterwards;
+ * see UnshareWords().
+ *
+ * The file is recognised by its size and HashData(); as the hash
+ * depends on the byte order, a DefaultRC.c made for another machine
+ * is never used.
+ */
+
+/*
+ * Whether `wl' holds just what ReadSettings() gives it to start with.
+ */
+
+static int Untouched(const struct WordList *wl)
+{
+    if (wl->NonEmpty)
+        return ((wl->Stack.Used == 1) && !*(char *) wl->Stack.Data[0]);
+    return (!wl->Stack.Used);
+}
+
+/*
+ * Whether no resource file has been read yet (or -g0 undid it).
+ */
+
+static int Pristine(void)
+{
+    unsigned long Cnt;
+
+    for (Cnt = 0; Keys[Cnt].Name; Cnt++)
+    {
+        if ((Keys[Cnt].List && !Untouched(Keys[Cnt].List)) ||
+            (Keys[Cnt].CaseList && !Untouched(Keys[Cnt].CaseList)) ||
+            (Keys[Cnt].String &&
+             strcmp(*Keys[Cnt].String, Keys[Cnt].Default)))
+            return (FALSE);
+    }
+    return (TRUE);
+}
+
+static void UseDefaultList(struct WordList *wl, const struct DefaultList *dl)
+{
+    struct Hash Hash;
+
+    Hash.Slots = (struct HashSlot *) dl->Slots;
+    Hash.Size = Hash.Used = dl->Size;
+    Hash.Disp = dl->Disp;
+    Hash.Buckets = dl->Buckets;
+
+    ShareWords(wl, dl->Words, dl->NumWords, dl->MaxLen, &Hash);
+}
+
+/*
+ * Takes the settings from DefaultRC if `Filename' is the chktexrc it
+ * was made from, and nothing else has been read. Returns whether it
+ * did.
+ */
+
+static int UseDefaultRC(const char *Filename)
+{
+    const struct DefaultKey *dk = DefaultRC.Keys;
+    const char *Data;
+    unsigned long Size, Cnt;
+    int Mapped, Same;
+
+    if (!dk || (DefaultRC.NumKeys != NumKeys()) || !Pristine())
+        return (FALSE);
+
+    for (Cnt = 0; Keys[Cnt].Name; Cnt++)
+    {
+        if (strcmp(Keys[Cnt].Name, dk[Cnt].Name))
+            return (FALSE);
+    }
+
+    if (!(Data = MapFile(Filename, &Size, &Mapped)))
+        return (FALSE);
+
+    Same = (Size == DefaultRC.Size) && (HashData(Data, Size) == DefaultRC.Hash);
+    UnmapFile(Data, Size, Mapped);
+
+    if (!Same)
+        return (FALSE);
+
+    for (Cnt = 0; Keys[Cnt].Name; Cnt++)
+    {
+        if (Keys[Cnt].List && dk[Cnt].List)
+            UseDefaultList(Keys[Cnt].List, dk[Cnt].List);
+        if (Keys[Cnt].CaseList && dk[Cnt].CaseList)
+            UseDefaultList(Keys[Cnt].CaseList, dk[Cnt].CaseList);
+        if (Keys[Cnt].String && dk[Cnt].String)
+            *Keys[Cnt].String = dk[Cnt].String;
+    }
+
+    return (TRUE);
+}
+
+/*
+ * Writes `Len' bytes of `Str' as a C string literal.
+ */
+
+static void WriteCString(FILE *fh, const char *Str, unsigned long Len)
+{
+    unsigned long i;
+    int c;
+
+    fputc('"', fh);
+    for (i = 0; i < Len; i++)
+    {
+        c = (unsigned char) Str[i];
+        if ((c == '"') || (c == '\\') || (c == '?'))
+            fprintf(fh, "\\%c", c);
+        else if ((c < 0x80) && isprint(c))
+            fputc(c, fh);
+        else
+            fprintf(fh, "\\%03o", c);
+    }
+    fputc('"', fh);
+}
+
+/*
+ * Writes the words of `wl', with the padding InsertWord() gives them,
+ * and a perfect hash index of them as DefaultList `List<Num>'.
+ */
+
+static int WriteDefaultList(FILE *fh, unsigned long Num,
+                            const struct WordList *wl)
+{
+    struct WordOff *Offs = NULL, *Found, Key;
+    struct HashSlot *hs;
+    struct Hash Perfect;
+    unsigned long i, Off = 0, Len;
+    int Success = TRUE;
+
+    if (!PerfectHash(&wl->Hash, &Perfect))
+        return (FALSE);
+
+    if (wl->Stack.Used)
+    {
+        if (!(Offs = malloc(wl->Stack.Used * sizeof(struct WordOff))))
+            PrintPrgErr(pmWordListErr);
+
+        fprintf(fh, "static const char Pool%lu[] =\n", Num);
+        FORWL(i, *wl)
+        {
+            Offs[i].Word = wl->Stack.Data[i];
+            Offs[i].Off = Off;
+            Len = strlen(Offs[i].Word) + 1 + WALLBYTES;
+            Off += Len;
+
+            fputs("    ", fh);
+            WriteCString(fh, Offs[i].Word, Len);
+            fputc('\n', fh);
+        }
+        fputs(";\n\n", fh);
+
+        fprintf(fh, "static const char *const Words%lu[] = {\n", Num);
+        FORWL(i, *wl)
+            fprintf(fh, "    &Pool%lu[%lu],\n", Num, Offs[i].Off);
+        fputs("};\n\n", fh);
+
+        qsort(Offs, wl->Stack.Used, sizeof(struct WordOff), CmpWordOff);
+    }
+
+    if (Perfect.Used)
+    {
+        fprintf(fh, "static const struct HashSlot Slots%lu[] = {\n", Num);
+        for (i = 0; Success && (i < Perfect.Size); i++)
+        {
+            hs = &Perfect.Slots[i];
+            Key.Word = hs->Str;
+            if (!(Found = bsearch(&Key, Offs, wl->Stack.Used,
+                                  sizeof(struct WordOff), CmpWordOff)))
+                Success = FALSE;
+            else
+                fprintf(fh, "    {UINT64_C(0x%08lx%08lx), %luUL, "
+                        "(char *) &Pool%lu[%lu], NULL},\n",
+                        (unsigned long) (hs->Hash >> 32),
+                        (unsigned long) (hs->Hash & 0xffffffff),
+                        hs->Len, Num, Found->Off);
+        }
+        fputs("};\n\n", fh);
+
+        fprintf(fh, "static const unsigned short Disp%lu[] = {", Num);
+        for (i = 0; i < Perfect.Buckets; i++)
+            fprintf(fh, "%s%u,", (i % 10) ? " " : "\n    ", Perfect.Disp[i]);
+        fputs("\n};\n\n", fh);
+    }
+
+    fprintf(fh, "static const struct DefaultList List%lu = {\n", Num);
+    if (wl->Stack.Used)
+        fprintf(fh, "    Words%lu, %luUL, %luUL,\n", Num, wl->Stack.Used,
+                wl->MaxLen);
+    else
+        fprintf(fh, "    NULL, 0UL, %luUL,\n", wl->MaxLen);
+    if (Perfect.Used)
+        fprintf(fh, "    Slots%lu, %luUL, Disp%lu, %luUL\n", Num,
+                Perfect.Size, Num, Perfect.Buckets);
+    else
+        fputs("    NULL, 0UL, NULL, 0UL\n", fh);
+    fputs("};\n\n", fh);
+
+    free(Offs);
+    free(Perfect.Slots);
+    free((void *) Perfect.Disp);
+    return (Success);
+}
+
+/*
+ * Reads `RCFile', as ReadSettings() would, and writes the lists and
+ * keywords it sets up to `Filename' as C source for DefaultRC.c.
+ * This is what mkdefrc does.
+ */
+
+int WriteDefaultRC(const char *RCFile, const char *Filename)
+{
+    const char *Data;
+    unsigned long Cnt, Num = 0, Size;
+    uint64_t Hash;
+    int Mapped, Success = TRUE;
+    FILE *fh;
+
+    GROWBUF(ReadBuffer, BUFSIZ);
+
+    for (Cnt = 0; Keys[Cnt].Name; Cnt++)
+    {
+        if (Keys[Cnt].List && Keys[Cnt].List->NonEmpty)
+            InsertWord("", Keys[Cnt].List);
+    }
+
+    if (!ReadRC(RCFile))
+        return (FALSE);
+
+    if (!(Data = MapFile(RCFile, &Size, &Mapped)))
+    {
+        PrintPrgErr(pmRsrcOpen, RCFile);
+        return (FALSE);
+    }
+    Hash = HashData(Data, Size);
+    UnmapFile(Data, Size, Mapped);
+
+    if (!(fh = fopen(Filename, "w")))
+    {
+        PrintPrgErr(pmOutOpen);
+        return (FALSE);
+    }
+
+    fprintf(fh, "/* Made from %s by mkdefrc; do not edit. */\n\n"
+            "#include \"ChkTeX.h\"\n"
+            "#include \"Utility.h\"\n"
+            "#include \"Resource.h\"\n\n", RCFile);
+
+    for (Cnt = 0; Success && Keys[Cnt].Name; Cnt++)
+    {
+        if (Keys[Cnt].List)
+            Success = WriteDefaultList(fh, Num++, Keys[Cnt].List);
+        if (Success && Keys[Cnt].CaseList)
+            Success = WriteDefaultList(fh, Num++, Keys[Cnt].CaseList);
+    }
+
+    fputs("static const struct DefaultKey DefaultKeys[] = {\n", fh);
+    for (Num = Cnt = 0; Success && Keys[Cnt].Name; Cnt++)
+    {
+        fprintf(fh, "    {\"%s\", ", Keys[Cnt].Name);
+        if (Keys[Cnt].List)
+            fprintf(fh, "&List%lu, ", Num++);
+        else
+            fputs("NULL, ", fh);
+        if (Keys[Cnt].CaseList)
+            fprintf(fh, "&List%lu, ", Num++);
+        else
+            fputs("NULL, ", fh);
+        if (Keys[Cnt].String)
+            WriteCString(fh, *Keys[Cnt].String, strlen(*Keys[Cnt].String));
+        else
+            fputs("NULL", fh);
+        fputs("},\n", fh);
+    }
+    fputs("};\n\n", fh);
+
+    fprintf(fh, "const struct DefaultRC DefaultRC = {\n"
+            "    %luUL, UINT64_C(0x%08lx%08lx), DefaultKeys, %luUL\n};\n",
+            Size, (unsigned long) (Hash >> 32),
+            (unsigned long) (Hash & 0xffffffff), Cnt);
+
+    if (ferror(fh) | fclose(fh))
+        Success = FALSE;
+
+    if (!Success)
+    {
+        remove(Filename);
+        PrintPrgErr(pmOutOpen);
+    }
+    return (Success);
+}
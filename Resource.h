@@ -62,6 +62,46 @@ RESOURCE_INFO
 #undef LNEMPTY
 #undef LIST
 int ReadRC(const char *);
+int WriteCompiled(const char *Filename);
+int LoadCompiled(const char *Filename);
+int WriteDefaultRC(const char *RCFile, const char *Filename);
+
+extern const char *CompiledConfig;
+
+/* Where the words and keyword values read go; see InsertWord() */
+extern struct Arena ConfigArena;
+
+/*
+ * The chktexrc we were built with, as read; mkdefrc writes these into
+ * DefaultRC.c. See ShareWords() and PerfectHash().
+ */
+
+struct DefaultList
+{
+    const char *const *Words;
+    unsigned long NumWords, MaxLen;
+    const struct HashSlot *Slots;
+    unsigned long Size;
+    const unsigned short *Disp;
+    unsigned long Buckets;
+};
+
+struct DefaultKey
+{
+    const char *Name;
+    const struct DefaultList *List, *CaseList;
+    const char *String;
+};
+
+struct DefaultRC
+{
+    unsigned long Size;         /* Of the resource file */
+    uint64_t Hash;              /* HashData() of the resource file */
+    const struct DefaultKey *Keys;
+    unsigned long NumKeys;
+};
+
+extern const struct DefaultRC DefaultRC;
 
 
 #endif /* RESOURCE */
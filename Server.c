@@ -0,0 +1,365 @@
+/*
+ *  ChkTeX, server mode.
+ *  Copyright (C) 1995-96 Jens T. Berger Thielemann
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *  Contact the author at:
+ *              Jens Berger
+ *              Spektrumvn. 4
+ *              N-0666 Oslo
+ *              Norway
+ *              E-mail: <jensthi@ifi.uio.no>
+ *
+ *
+ */
+
+/*
+ * With --serve, we read the configuration once and then check any
+ * number of documents, without paying for the startup (reading the
+ * resource files and compiling the regular expressions) each time.
+ *
+ * Requests are read from stdin (or from each client connecting to the
+ * Unix socket given with --serve=PATH), and look like
+ *
+ *      CHECK <namelen> <optlen> <datalen>\n
+ *      <name><options><data>
+ *
+ * where the lengths are byte counts of the following fields. <name>
+ * is only used in the reports, and <options> is a blank separated list
+ * of the options -w, -e, -m, -n (with a number or `all') and -L, which
+ * apply to this document only. For each warning, error or message we
+ * answer
+ *
+ *      DIAG <line> <column> <length> <number> <kind> <filelen> <msglen>\n
+ *      <file><message>
+ *
+ * with <kind> being one of `Message', `Warning' or `Error', followed by
+ *
+ *      DONE <errors> <warnings>\n
+ *
+ * once the document has been checked. A request we can't serve is
+ * answered with `FAIL <msglen>\n<message>' instead. If we couldn't
+ * even read it, we give up on the stream, as we can't know where the
+ * next request starts. `QUIT\n' ends the stream.
+ */
+
+#include "ChkTeX.h"
+#include "FindErrs.h"
+#include "OpSys.h"
+#include "Utility.h"
+#include "Recheck.h"
+#include "Server.h"
+#include <string.h>
+
+#if defined(HAVE_SYS_SOCKET_H) && defined(HAVE_SYS_UN_H) && \
+    defined(HAVE_UNISTD_H)
+#  define USE_SOCKETS 1
+#  include <sys/types.h>
+#  include <sys/socket.h>
+#  include <sys/stat.h>
+#  include <sys/un.h>
+#  include <unistd.h>
+#  include <signal.h>
+#else
+#  define USE_SOCKETS 0
+#endif
+
+/*
+ * Longest request line we accept; they're all quite short.
+ */
+#define REQLINELEN      128
+
+static const char *KindNames[] = { "Message", "Warning", "Error" };
+
+static void SendDiag(const struct ChkTeXDiag *Diag, void *UserData)
+{
+    FILE *Out = UserData;
+
+    fprintf(Out, "DIAG %lu %ld %ld %d %s %lu %lu\n", Diag->Line,
+            Diag->Column, Diag->Length, Diag->Number,
+            KindNames[Diag->Kind], (unsigned long) strlen(Diag->File),
+            (unsigned long) strlen(Diag->Message));
+    fputs(Diag->File, Out);
+    fputs(Diag->Message, Out);
+}
+
+static void SendFail(FILE *Out, const char *Message)
+{
+    fprintf(Out, "FAIL %lu\n%s", (unsigned long) strlen(Message), Message);
+    fflush(Out);
+}
+
+/*
+ * Reads exactly `Len' bytes into `*Buf', zero terminated, growing it
+ * as necessary. Returns NULL on success, otherwise why we failed.
+ */
+
+static const char *ReadField(FILE *In, char **Buf, unsigned long *BufSize,
+                             unsigned long Len)
+{
+    char *New;
+
+    if (Len + 1 > *BufSize)
+    {
+        if (!(Len + 1) || !(New = realloc(*Buf, Len + 1)))
+            return ("Request too large.");
+        *Buf = New;
+        *BufSize = Len + 1;
+    }
+
+    if (Len && (fread(*Buf, 1, Len, In) != Len))
+        return ("Request truncated.");
+
+    (*Buf)[Len] = 0;
+    return (NULL);
+}
+
+/*
+ * Applies the per-document options in `Opts'. Returns FALSE if they
+ * were faulty.
+ */
+
+static int SetOptions(char *Opts)
+{
+    char *Tok, *Arg;
+    long Err;
+    int ErrType, InUse, i;
+
+    for (Tok = strtok(Opts, " \t\r\n"); Tok; Tok = strtok(NULL, " \t\r\n"))
+    {
+        if ((Tok[0] != '-') || !Tok[1])
+            return (FALSE);
+
+        switch (Tok[1])
+        {
+        case 'L':
+            if (Tok[2])
+                return (FALSE);
+            NoLineSupp = TRUE;
+            continue;
+        case 'w':
+            ErrType = etWarn;
+            InUse = iuOK;
+            break;
+        case 'e':
+            ErrType = etErr;
+            InUse = iuOK;
+            break;
+        case 'm':
+            ErrType = etMsg;
+            InUse = iuOK;
+            break;
+        case 'n':
+            ErrType = etMsg;
+            InUse = iuNotUser;
+            break;
+        default:
+            return (FALSE);
+        }
+
+        if (!*(Arg = &Tok[2]) && !(Arg = strtok(NULL, " \t\r\n")))
+            return (FALSE);
+
+        if (!strcasecmp(Arg, "all"))
+        {
+            for (i = emMinFault + 1; i < emMaxFault; i++)
+            {
+                LaTeXMsgs[i].Type = ErrType;
+                LaTeXMsgs[i].InUse = InUse;
+            }
+        }
+        else if (isdigit((unsigned char)*Arg))
+        {
+            Err = strtol(Arg, &Arg, 10);
+            if (*Arg || !betw(emMinFault, Err, emMaxFault))
+                return (FALSE);
+            LaTeXMsgs[Err].Type = ErrType;
+            LaTeXMsgs[Err].InUse = InUse;
+        }
+        else
+            return (FALSE);
+    }
+    return (TRUE);
+}
+
+/*
+ * Answers requests from `In' on `Out' until we're told to quit or the
+ * stream ends. Returns FALSE if we had to give up on a faulty request.
+ */
+
+int ServeStream(FILE *In, FILE *Out)
+{
+    static struct ErrMsg SavedMsgs[emMaxFault + 1];
+    char Line[REQLINELEN], *Name = NULL, *Opts = NULL, *Data = NULL;
+    unsigned long NameSize = 0, OptsSize = 0, DataSize = 0;
+    unsigned long NameLen, OptsLen, DataLen, Errors, Warnings;
+    struct ChkTeXSession *Session = NULL;
+    char *SessionOpts = NULL;
+    const char *Fail;
+    int SavedLineSupp, Retval = TRUE;
+
+    while (fgets(Line, REQLINELEN, In))
+    {
+        if (!strcmp(Line, "QUIT\n"))
+            break;
+
+        if (sscanf(Line, "CHECK %lu %lu %lu\n",
+                   &NameLen, &OptsLen, &DataLen) != 3)
+        {
+            SendFail(Out, "Bad request.");
+            Retval = FALSE;
+            break;
+        }
+
+        if ((Fail = ReadField(In, &Name, &NameSize, NameLen)) ||
+            (Fail = ReadField(In, &Opts, &OptsSize, OptsLen)) ||
+            (Fail = ReadField(In, &Data, &DataSize, DataLen)))
+        {
+            SendFail(Out, Fail);
+            Retval = FALSE;
+            break;
+        }
+
+        /*
+         * Editors tend to send the same document over and over, with
+         * small changes; the session only checks what changed.
+         */
+        if (!SessionOpts || strcmp(SessionOpts, Opts))
+        {
+            FreeSession(Session);
+            free(SessionOpts);
+            if (!(SessionOpts = strdup(Opts)))
+                PrintPrgErr(pmStrDupErr);
+            Session = NewSession();
+        }
+
+        memcpy(SavedMsgs, LaTeXMsgs, sizeof(SavedMsgs));
+        SavedLineSupp = NoLineSupp;
+
+        if (!SetOptions(Opts))
+            SendFail(Out, "Bad options.");
+        else if (!Session || (Recheck(Session, *Name ? Name : "stdin",
+                                      Data, DataLen, SendDiag, Out) < 0))
+            SendFail(Out, "Out of memory.");
+        else
+        {
+            SessionCounts(Session, &Errors, &Warnings);
+            fprintf(Out, "DONE %lu %lu\n", Errors, Warnings);
+            fflush(Out);
+        }
+
+        memcpy(LaTeXMsgs, SavedMsgs, sizeof(SavedMsgs));
+        NoLineSupp = SavedLineSupp;
+
+        if (ferror(Out))
+        {
+            Retval = FALSE;
+            break;
+        }
+    }
+
+    FreeSession(Session);
+    free(SessionOpts);
+    free(Name);
+    free(Opts);
+    free(Data);
+    return (Retval);
+}
+
+#if USE_SOCKETS
+
+/*
+ * Serves each client connecting to the Unix socket `Path', one at a
+ * time. Only returns if we couldn't set up the socket.
+ */
+
+static int ServeUnix(const char *Path)
+{
+    struct sockaddr_un Addr;
+    struct stat Stat;
+    int Sock, Conn;
+    FILE *In, *Out;
+
+    if (strlen(Path) >= sizeof(Addr.sun_path))
+        return (FALSE);
+
+    memset(&Addr, 0, sizeof(Addr));
+    Addr.sun_family = AF_UNIX;
+    strcpy(Addr.sun_path, Path);
+
+    /* Remove what an earlier server left behind, but nothing else */
+    if (!lstat(Path, &Stat) && S_ISSOCK(Stat.st_mode))
+        unlink(Path);
+
+    if ((Sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return (FALSE);
+
+    if (bind(Sock, (struct sockaddr *) &Addr, sizeof(Addr)) ||
+        listen(Sock, 8))
+    {
+        close(Sock);
+        return (FALSE);
+    }
+
+    /* A client going away shouldn't take us with it */
+    signal(SIGPIPE, SIG_IGN);
+
+    for (;;)
+    {
+        if ((Conn = accept(Sock, NULL, NULL)) < 0)
+            continue;
+
+        if (!(In = fdopen(Conn, "r")))
+        {
+            close(Conn);
+            continue;
+        }
+
+        if ((Conn = dup(Conn)) >= 0)
+        {
+            if ((Out = fdopen(Conn, "w")))
+            {
+                ServeStream(In, Out);
+                fclose(Out);
+            }
+            else
+                close(Conn);
+        }
+
+        fclose(In);
+    }
+}
+
+#endif
+
+/*
+ * Serves requests on `Socket', or stdin/stdout if that is NULL.
+ */
+
+int Serve(const char *Socket)
+{
+    if (!Socket)
+        return (ServeStream(stdin, stdout) ? EXIT_SUCCESS : EXIT_FAILURE);
+
+#if USE_SOCKETS
+    if (!ServeUnix(Socket))
+        PrintPrgErr(pmServeSocket, Socket);
+#else
+    PrintPrgErr(pmNoSockets);
+#endif
+
+    return (EXIT_FAILURE);
+}
@@ -31,46 +31,9 @@
 #include "Resource.h"
 #include "OpSys.h"
 
-typedef unsigned long HASH_TYPE;
-
 /***************************** SUPPORT FUNCTIONS ************************/
 
 
-/*
- * Copies a string with a maximum length of `len' starting at `pos' in
- * `source' into `dest'.
- * Returns -1 if the pos value is beyond the length of the source value,
- * else NULL.
- */
-
-
-short substring(const char *source, char *dest, unsigned long pos, long len)
-{
-    const char *Start;
-    short Retval = -1;
-
-    if (len >= 0)
-    {
-        if (strlen(source) > pos)
-        {
-            Start = &source[pos];
-
-            while ((len-- > 0) && (*dest++ = *Start++))
-                ;
-
-            if (len == -1)
-                Retval = 0;
-        }
-    }
-    else
-        Retval = 0L;
-
-    *dest = 0;
-
-    return (Retval);
-}
-
-
 /*
  * Determine whether a file exists.
  *
@@ -103,23 +66,33 @@ int fexists(const char *Filename)
 
 
 /*
- * 'Safe' memset() replacement.
- * Just tries to check the parameters, so that the risk of killing
- * innocent memory is lowered.
- * Please note that the `n' parameter now is an signed longword, not
- * an size_t. Won't permit that `n' exceeds BUFLEN, nor negative sizes.
- * Returns `to' if some memset()'ing was done, NULL if not.
+ * Makes sure that a NEWBUF() buffer can hold at least `Len' bytes. We
+ * grow geometrically, so that repeatedly asking for a little more
+ * stays cheap. The contents are preserved, and the walls and any new
+ * space are zeroed.
  */
 
-void *sfmemset(void *to, int c, long n)
+void GrowBuf(char **Buf, unsigned long *Size, unsigned long Len)
 {
-    if (to && (n > 0))
+    unsigned long NewSize;
+    char *NewBuf;
+
+    if (Len > *Size)
     {
-        n = min(n, BUFSIZ);
+        NewSize = max(Len, *Size << 1);
+        NewSize = max(NewSize, BUFSIZ);
+
+        if (!(NewBuf = saferealloc(*Buf ? *Buf - WALLBYTES : NULL,
+                                   NewSize + (WALLBYTES << 1))))
+            PrintPrgErr(pmNoStackMem);
 
-        return (memset(to, c, (size_t) n));
+        if (!*Buf)
+            memset(NewBuf, 0, WALLBYTES);
+        memset(&NewBuf[WALLBYTES + *Size], 0, NewSize - *Size + WALLBYTES);
+
+        *Buf = &NewBuf[WALLBYTES];
+        *Size = NewSize;
     }
-    return (NULL);
 }
 
 
@@ -325,8 +298,6 @@ void strwrite(char *To, const char *From, unsigned long Len)
     unsigned long i, j;
     unsigned long FromLen = strlen(From);
 
-    Len = min(Len, BUFSIZ);
-
     if (To && From)
     {
         switch (FromLen)
@@ -384,107 +355,344 @@ int strinfront(const char *Str, const char *Cmp)
 /*************************** HASH INDEX **************************/
 
 /*
- * Hashes a string. The string ought be rather short.
- *
- * The algorithm was designed by Peter Weinberger. This version was
- * adapted from Dr Dobb's Journal April 1996 page 26.
+ * Mixes the bits of `x' thoroughly; this is the finalizer of
+ * splitmix64.
+ */
+
+static uint64_t HashMix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= UINT64_C(0xbf58476d1ce4e5b9);
+    x ^= x >> 27;
+    x *= UINT64_C(0x94d049bb133111eb);
+    x ^= x >> 31;
+    return (x);
+}
+
+/*
+ * Hashes `Len' bytes of `Data'. They're taken eight at a time, each
+ * lot being mixed into the hash.
  */
 
-static unsigned long HashWord(const char *str)
+uint64_t HashData(const char *Data, unsigned long Len)
 {
-    register unsigned long h = 0, hbit, c;
+    unsigned long i;
+    uint64_t h = UINT64_C(0x9e3779b97f4a7c15) ^ Len, w;
 
-    while ((c = *str++))
+    for (i = 0; i + 8 <= Len; i += 8)
     {
-        h = (h << 4) ^ c;
-        if ((hbit = h & 0xf0000000))
-            h ^= hbit >> 24;
-        h &= ~hbit;
+        memcpy(&w, &Data[i], 8);
+        h = HashMix(h ^ w);
     }
 
-    return (h);
+    w = 0;
+    memcpy(&w, &Data[i], Len - i);
+
+    return (HashMix(h ^ w));
 }
 
 /*
- * Inserts a string into a hash index. Note: You'll have to
- * duplicate the string yourself.
+ * Hashes a string, and puts its length in `*Len'.
  */
 
-void InsertHash(char *a, struct Hash *h)
+static uint64_t HashWord(const char *Str, unsigned long *Len)
+{
+    *Len = strlen(Str);
+    return (HashData(Str, *Len));
+}
+
+/*
+ * Where a string with hash `Hash' goes in a perfect hash index of
+ * `Size' slots, given the displacement `Disp' of its bucket. The
+ * bucket is picked by the upper half of the hash.
+ */
+
+#define MAXDISP         0xffffUL        /* Fits in an unsigned short */
+#define PERFECTBUCKET(Hash, Buckets) \
+    ((unsigned long) ((((Hash) >> 32) * (Buckets)) >> 32))
+
+static unsigned long PerfectPos(uint64_t Hash, unsigned long Disp,
+                                unsigned long Size)
+{
+    return ((unsigned long)
+            (((HashMix(Hash + Disp) & UINT64_C(0xffffffff)) * Size) >> 32));
+}
+
+/*
+ * Finds the slot of `Str' (with hash `Hash' and length `Len') in `h',
+ * or the free slot where it belongs. There has to be a free slot.
+ */
+
+static struct HashSlot *FindSlot(const struct Hash *h, const char *Str,
+                                 uint64_t Hash, unsigned long Len)
 {
-    struct HashEntry **he, *newhe;
+    unsigned long Mask = h->Size - 1, i;
+    struct HashSlot *hs;
 
-    if (!h->Index)
+    for (i = (unsigned long) Hash & Mask;; i = (i + 1) & Mask)
     {
-        if (!((h->Index = calloc(HASH_SIZE, sizeof(struct HashEntry *)))))
-            PrintPrgErr(pmWordListErr);
+        hs = &h->Slots[i];
+        if (!hs->Str || ((hs->Hash == Hash) && (hs->Len == Len) &&
+                         !memcmp(hs->Str, Str, Len)))
+            return (hs);
     }
+}
 
-    he = &h->Index[HashWord(a) % HASH_SIZE];
+/*
+ * Doubles the number of slots in a hash index (or makes the first
+ * ones).
+ */
 
-    if ((newhe = malloc(sizeof(struct HashEntry))))
+static void GrowHash(struct Hash *h)
+{
+    struct HashSlot *Old = h->Slots, *hs;
+    unsigned long OldSize = h->Size, i;
+
+    h->Size = OldSize ? (OldSize << 1) : HASH_MINSIZE;
+    if (!(h->Slots = calloc(h->Size, sizeof(struct HashSlot))))
+        PrintPrgErr(pmWordListErr);
+
+    for (i = 0; i < OldSize; i++)
     {
-        newhe->Next = *he;
-        newhe->Str = a;
-        *he = newhe;
+        if (Old[i].Str)
+        {
+            hs = FindSlot(h, Old[i].Str, Old[i].Hash, Old[i].Len);
+            *hs = Old[i];
+        }
     }
-    else
-        PrintPrgErr(pmWordListErr);
+    free(Old);
 }
 
 /*
- * Checks whether a string previously has been registered in a
- * hash index.
+ * Finds the slot of `a' in a hash index, making one if there is none
+ * yet; a new slot has `a' as its string, and no data. Note: You'll
+ * have to duplicate the string yourself.
+ *
+ * The index is kept at most 3/4 full, so that probe sequences stay
+ * short.
  */
 
-char *HasHash(const char *a, const struct Hash *h)
+struct HashSlot *AddHash(char *a, struct Hash *h)
+{
+    struct HashSlot *hs;
+    unsigned long Len;
+    uint64_t Hash;
+
+    if ((h->Used + 1) * 4 > h->Size * 3)
+        GrowHash(h);
+
+    Hash = HashWord(a, &Len);
+    hs = FindSlot(h, a, Hash, Len);
+
+    if (!hs->Str)
+    {
+        hs->Hash = Hash;
+        hs->Len = Len;
+        hs->Str = a;
+        h->Used++;
+    }
+    return (hs);
+}
+
+/*
+ * Inserts a string into a hash index. If the index already has an
+ * equal string, `a' takes its place; lookups find the latest one.
+ */
+
+void InsertHash(char *a, struct Hash *h)
 {
-    struct HashEntry *he;
-    HASH_TYPE i;                /* Special magic to optimize SAS/C */
+    AddHash(a, h)->Str = a;
+}
+
+/*
+ * Finds the slot of `a' in a hash index, or NULL if it isn't there.
+ */
+
+struct HashSlot *FindHash(const char *a, const struct Hash *h)
+{
+    struct HashSlot *hs;
+    unsigned long Len;
+    uint64_t Hash;
 
     /* Do we have a hash? */
-    if (!h->Index)
+    if (!h->Used)
         return NULL;
 
-    /* Find entry in hash */
-    i = HashWord(a);
-    i %= HASH_SIZE;
-    he = h->Index[i];
+    Hash = HashWord(a, &Len);
 
-    /* Search in the entry for the item */
-    while (he)
+    if (h->Disp)
     {
-        if (!strcmp(he->Str, a))
-            return (he->Str);
-        else
-            he = he->Next;
+        hs = &h->Slots[PerfectPos(Hash, h->Disp[PERFECTBUCKET(Hash,
+                                                              h->Buckets)],
+                                  h->Size)];
+        return (((hs->Hash == Hash) && (hs->Len == Len) &&
+                 !memcmp(hs->Str, a, Len)) ? hs : NULL);
     }
-    return (NULL);
+
+    hs = FindSlot(h, a, Hash, Len);
+    return (hs->Str ? hs : NULL);
+}
+
+/* A string of a perfect hash index to be, and where it's going */
+struct PerfectKey
+{
+    struct HashSlot Slot;
+    unsigned long Bucket;
+};
+
+static int CmpPerfectKey(const void *a, const void *b)
+{
+    unsigned long BucketA = ((const struct PerfectKey *) a)->Bucket;
+    unsigned long BucketB = ((const struct PerfectKey *) b)->Bucket;
+
+    return ((BucketA > BucketB) - (BucketA < BucketB));
 }
 
 /*
- * Clears a hash table.
+ * Tries to find displacements which take the strings of `Keys', being
+ * sorted by bucket, to slots of their own. The biggest buckets go
+ * first, while there are still many free slots.
  */
 
-void ClearHash(struct Hash *h)
+static int Displace(struct PerfectKey *Keys, unsigned long Num,
+                    unsigned short *Disp, unsigned long Buckets,
+                    struct HashSlot *Slots)
 {
-    int i;
-    struct HashEntry *he, *next;
-    if (h && h->Index)
+    unsigned long *Start, Size, Max = 0, b, i;
+    unsigned long d;
+    int Success = TRUE;
+
+    if (!(Start = calloc(Buckets + 1, sizeof(unsigned long))))
+        PrintPrgErr(pmWordListErr);
+
+    for (i = 0; i < Num; i++)
+        Start[Keys[i].Bucket + 1]++;
+    for (b = 0; b < Buckets; b++)
+    {
+        Max = max(Max, Start[b + 1]);
+        Start[b + 1] += Start[b];
+    }
+
+    for (Size = Max; Success && Size; Size--)
     {
-        /* Free all the memory */
-        for ( i = 0; i < HASH_SIZE; ++i )
+        for (b = 0; Success && (b < Buckets); b++)
         {
-            he = h->Index[i];
-            while ( he )
+            if (Start[b + 1] - Start[b] != Size)
+                continue;
+
+            for (d = 0; d <= MAXDISP; d++)
             {
-                next = he->Next;
-                free( he );
-                he = next;
+                for (i = Start[b]; i < Start[b + 1]; i++)
+                {
+                    struct HashSlot *hs =
+                        &Slots[PerfectPos(Keys[i].Slot.Hash, d, Num)];
+
+                    if (hs->Str)
+                        break;
+                    *hs = Keys[i].Slot;
+                }
+
+                if (i == Start[b + 1])
+                    break;
+
+                /* Take back the ones which did fit */
+                while (i-- > Start[b])
+                    Slots[PerfectPos(Keys[i].Slot.Hash, d, Num)].Str = NULL;
             }
+
+            if (d > MAXDISP)
+                Success = FALSE;
+            else
+                Disp[b] = (unsigned short) d;
         }
-        /* Reset the hash table */
-        memset(h->Index, '\0', HASH_SIZE * sizeof(struct HashEntry *));
+    }
+
+    free(Start);
+    return (Success);
+}
+
+/*
+ * Makes a perfect hash index of the strings in `In': they all get a
+ * slot of their own, so a lookup looks at a single one. Making one is
+ * slow, so this is for mkdefrc; see WriteDefaultRC(). Returns FALSE
+ * if no displacements could be found.
+ */
+
+int PerfectHash(const struct Hash *In, struct Hash *Out)
+{
+    struct PerfectKey *Keys;
+    unsigned short *Disp = NULL;
+    unsigned long Num = 0, i;
+    int Success = FALSE;
+
+    memset(Out, 0, sizeof(struct Hash));
+    if (!In->Used)
+        return (TRUE);
+
+    if (!(Keys = malloc(In->Used * sizeof(struct PerfectKey))))
+        PrintPrgErr(pmWordListErr);
+
+    for (i = 0; i < In->Size; i++)
+    {
+        if (In->Slots[i].Str)
+            Keys[Num++].Slot = In->Slots[i];
+    }
+
+    /* Fewer buckets make a smaller index, but are harder to fit */
+    for (Out->Buckets = Num / 2 + 1; Out->Buckets <= Num * 4;
+         Out->Buckets <<= 1)
+    {
+        for (i = 0; i < Num; i++)
+            Keys[i].Bucket = PERFECTBUCKET(Keys[i].Slot.Hash, Out->Buckets);
+        qsort(Keys, Num, sizeof(struct PerfectKey), CmpPerfectKey);
+
+        free(Disp);
+        free(Out->Slots);
+        if (!(Disp = calloc(Out->Buckets, sizeof(unsigned short))) ||
+            !(Out->Slots = calloc(Num, sizeof(struct HashSlot))))
+            PrintPrgErr(pmWordListErr);
+
+        if ((Success = Displace(Keys, Num, Disp, Out->Buckets, Out->Slots)))
+            break;
+    }
+
+    free(Keys);
+    if (Success)
+    {
+        Out->Size = Out->Used = Num;
+        Out->Disp = Disp;
+    }
+    else
+    {
+        free(Disp);
+        free(Out->Slots);
+        memset(Out, 0, sizeof(struct Hash));
+    }
+    return (Success);
+}
+
+/*
+ * Checks whether a string previously has been registered in a
+ * hash index.
+ */
+
+char *HasHash(const char *a, const struct Hash *h)
+{
+    struct HashSlot *hs = FindHash(a, h);
+
+    return (hs ? hs->Str : NULL);
+}
+
+/*
+ * Clears a hash table.
+ */
+
+void ClearHash(struct Hash *h)
+{
+    if (h && h->Slots)
+    {
+        memset(h->Slots, 0, h->Size * sizeof(struct HashSlot));
+        h->Used = 0;
     }
 }
 
@@ -502,31 +710,81 @@ static void ReHash(struct WordList *WL)
     FORWL(i, *WL) InsertHash(WL->Stack.Data[i], &WL->Hash);
 }
 
+/***************************** DIGESTS *******************************/
+
+/*
+ * Digests of file contents and settings, for the result cache. This is
+ * the 128 bit variant of FNV-1a (Fowler/Noll/Vo); not cryptographic,
+ * but with 128 bits accidental collisions are out of the question.
+ */
+
+void InitDigest(struct Digest *d)
+{
+    d->Hi = UINT64_C(0x6c62272e07bb0142);
+    d->Lo = UINT64_C(0x62b821756295c58d);
+}
+
+void AddDigest(struct Digest *d, const void *Data, unsigned long Len)
+{
+    const unsigned char *Ptr = Data;
+    uint64_t Lo, Carry;
+
+    /* The prime is 2^88 + 0x13b */
+    while (Len--)
+    {
+        Lo = d->Lo ^ *Ptr++;
+        Carry = (((Lo >> 32) * 0x13b) + (((Lo & 0xffffffff) * 0x13b) >> 32))
+            >> 32;
+        d->Hi = (d->Hi * 0x13b) + Carry + (Lo << 24);
+        d->Lo = Lo * 0x13b;
+    }
+}
+
+/*
+ * Adds `Str' with its terminator, so that consecutive strings can't
+ * run into each other.
+ */
+
+void AddDigestStr(struct Digest *d, const char *Str)
+{
+    AddDigest(d, Str ? Str : "", Str ? strlen(Str) + 1 : 1);
+}
+
+/*
+ * Writes `d' as 32 hex digits and a terminator to `Buf'.
+ */
+
+void DigestHex(const struct Digest *d, char *Buf)
+{
+    sprintf(Buf, "%08lx%08lx%08lx%08lx",
+            (unsigned long) (d->Hi >> 32), (unsigned long) (d->Hi & 0xffffffff),
+            (unsigned long) (d->Lo >> 32), (unsigned long) (d->Lo & 0xffffffff));
+}
+
 /*************************** WORDLIST HANDLING **************************/
 
 /*
  * Inserts a duplicate of `Word' into the `Wordlist' structure. You do thus
- * not need to make a duplicate of `Word' yourself.
+ * not need to make a duplicate of `Word' yourself; it goes in ConfigArena.
  */
 
 int InsertWord(const char *Word, struct WordList *WL)
 {
     char *WrdCpy;
-    unsigned long Len;
+    unsigned long Len = strlen(Word);
 
-    if ((WrdCpy = strdupx(Word, WALLBYTES)))
+    UnshareWords(WL);
+
+    if ((WrdCpy = ArenaString(&ConfigArena, Word, Len, WALLBYTES)))
     {
         if (StkPush(WrdCpy, &WL->Stack))
         {
-            Len = strlen(Word);
             if (WL->MaxLen < Len)
                 WL->MaxLen = Len;
 
             InsertHash(WrdCpy, &WL->Hash);
             return (TRUE);
         }
-
-        free(WrdCpy);
     }
 
     return (FALSE);
@@ -538,13 +796,17 @@ int InsertWord(const char *Word, struct WordList *WL)
 
 void ClearWord(struct WordList *WL)
 {
-    char *Word;
     if (WL)
     {
-        while ( (Word = StkPop( &WL->Stack )) )
+        /* The words aren't ours to free; see ShareWords() */
+        if (WL->Mapped)
         {
-            free(Word);
+            memset(&WL->Stack, 0, sizeof(struct Stack));
+            memset(&WL->Hash, 0, sizeof(struct Hash));
+            WL->Mapped = FALSE;
         }
+
+        /* The words stay in ConfigArena until all of it goes */
         WL->Stack.Used = 0;
         WL->MaxLen = 0;
         ClearHash(&WL->Hash);
@@ -553,6 +815,62 @@ void ClearWord(struct WordList *WL)
     }
 }
 
+/*
+ * Makes `WL' use `NumWords' words and a hash index kept elsewhere, as
+ * for the built-in configuration. They are not written to; see
+ * UnshareWords().
+ */
+
+void ShareWords(struct WordList *WL, const char *const *Words,
+                unsigned long NumWords, unsigned long MaxLen,
+                const struct Hash *Hash)
+{
+    if (!WL->Mapped)
+    {
+        free(WL->Stack.Data);
+        free(WL->Hash.Slots);
+    }
+
+    WL->Stack.Data = (void **) Words;
+    WL->Stack.Size = WL->Stack.Used = NumWords;
+    WL->Hash = *Hash;
+    WL->MaxLen = MaxLen;
+    WL->Mapped = TRUE;
+}
+
+/*
+ * Gives `WL' words and a hash index of its own, instead of those of
+ * a compiled or built-in configuration, so that it can be changed.
+ */
+
+void UnshareWords(struct WordList *WL)
+{
+    struct Stack Shared = WL->Stack;
+    unsigned long i, Len;
+    char *Word;
+
+    if (!WL->Mapped)
+        return;
+
+    memset(&WL->Stack, 0, sizeof(struct Stack));
+    memset(&WL->Hash, 0, sizeof(struct Hash));
+    WL->Mapped = FALSE;
+
+    for (i = 0; i < Shared.Used; i++)
+    {
+        /* ListRep() may have split it in two; see EmitWord() */
+        Word = Shared.Data[i];
+        Len = strlen(Word) + 1;
+        Len += strlen(&Word[Len]) + 1;
+
+        if (!(Word = ArenaString(&ConfigArena, Word, Len, WALLBYTES)) ||
+            !StkPush(Word, &WL->Stack))
+            PrintPrgErr(pmWordListErr);
+
+        InsertHash(Word, &WL->Hash);
+    }
+}
+
 /*
  * Query whether a `Word' is previously InsertWord()'ed into the WL
  * structure. Does case-sensitive comparison.
@@ -574,6 +892,7 @@ char *HasWord(const char *Word, struct WordList *WL)
 void MakeLower(struct WordList *wl)
 {
     unsigned long i;
+    UnshareWords(wl);
     FORWL(i, *wl) strlwr(wl->Stack.Data[i]);
     ReHash(wl);
 }
@@ -585,12 +904,377 @@ void MakeLower(struct WordList *wl)
 void ListRep(struct WordList *wl, const char From, const char To)
 {
     unsigned long i;
+    UnshareWords(wl);
     FORWL(i, *wl) strrep(wl->Stack.Data[i], From, To);
     ReHash(wl);
 }
 
 
 
+/****************************** ARENAS ********************************/
+
+/*
+ * An arena hands out memory for strings which live as long as each
+ * other, such as the words of the settings. Taking them from a few big
+ * blocks packs them together, costs no more than a pointer bump each,
+ * and lets them all be freed at once with FreeArena().
+ */
+
+#define ARENA_BLOCK     8192    /* Bytes in a block, unless more is wanted */
+
+struct ArenaBlock
+{
+    struct ArenaBlock *Next;
+    unsigned long Size, Used;
+    char Data[1];
+};
+
+/*
+ * Copies `Len' bytes of `Str' into `a', followed by a terminator and
+ * `Extra' zeroed bytes. Returns NULL if out of memory.
+ */
+
+char *ArenaString(struct Arena *a, const char *Str, unsigned long Len,
+                  unsigned long Extra)
+{
+    struct ArenaBlock *Block = a->Block;
+    unsigned long Need = Len + 1 + Extra, Size;
+    char *Retval;
+
+    if (!Block || (Block->Size - Block->Used < Need))
+    {
+        /* Blocks are zeroed, and never reused, so the padding is free */
+        Size = max(Need, ARENA_BLOCK);
+        if (!(Block = calloc(1, offsetof(struct ArenaBlock, Data) + Size)))
+            return (NULL);
+
+        Block->Size = Size;
+        Block->Next = a->Block;
+        a->Block = Block;
+    }
+
+    Retval = &Block->Data[Block->Used];
+    memcpy(Retval, Str, Len);
+    Block->Used += Need;
+
+    return (Retval);
+}
+
+/*
+ * Frees everything handed out by `a'.
+ */
+
+void FreeArena(struct Arena *a)
+{
+    struct ArenaBlock *Block;
+
+    while ((Block = a->Block))
+    {
+        a->Block = Block->Next;
+        free(Block);
+    }
+}
+
+/****************************** TRIES ********************************/
+
+/*
+ * A trie of the words of a list, which finds every word at the start
+ * (or, if built reversed, the end) of a string in one walk, however
+ * many words there are. Node 0 is the root; the edges of each node
+ * are kept together, so that a step is a memchr() of their labels.
+ */
+
+/*
+ * Gives the nodes for `Count' sorted keys, the first `Depth' bytes of
+ * which are the same, and their subtrees; the first goes in `Node'.
+ * Returns FALSE if out of memory.
+ */
+
+static int TrieNodes(struct Trie *t, char **Keys, unsigned long Count,
+                     unsigned long Depth, unsigned long *Node)
+{
+    unsigned long i, j, Edges, Edge, Child;
+    struct TrieNode *tn;
+
+    if (t->Used == t->Size)
+    {
+        t->Size = t->Size ? t->Size * 2 : MINPUDDLE;
+        if (!(t->Nodes = saferealloc(t->Nodes,
+                                     t->Size * sizeof(struct TrieNode))))
+            return (FALSE);
+    }
+
+    *Node = t->Used++;
+    tn = &t->Nodes[*Node];
+
+    /* The key which ends here sorts first */
+    tn->Final = (!Keys[0][Depth]);
+    if (tn->Final)
+    {
+        Keys++;
+        Count--;
+    }
+
+    /* The edges of a node go together, before those of its children */
+    for (Edges = 0, i = 0; i < Count; i++)
+    {
+        if (!i || (Keys[i][Depth] != Keys[i - 1][Depth]))
+            Edges++;
+    }
+    tn->Edges = Edge = t->NumEdges;
+    tn->Count = (unsigned short) Edges;
+    t->NumEdges += Edges;
+    if (Edges &&
+        (!(t->Labels = saferealloc(t->Labels, t->NumEdges)) ||
+         !(t->Next = saferealloc(t->Next,
+                                 t->NumEdges * sizeof(unsigned long)))))
+        return (FALSE);
+
+    for (i = 0; i < Count; i = j, Edge++)
+    {
+        for (j = i + 1; (j < Count) && (Keys[j][Depth] == Keys[i][Depth]); j++)
+            ;
+        /* The arrays may move while the subtree is built */
+        if (!TrieNodes(t, &Keys[i], j - i, Depth + 1, &Child))
+            return (FALSE);
+        t->Labels[Edge] = Keys[i][Depth];
+        t->Next[Edge] = Child;
+    }
+
+    return (TRUE);
+}
+
+static int CmpKeys(const void *a, const void *b)
+{
+    return (strcmp(*(char *const *) a, *(char *const *) b));
+}
+
+/*
+ * Builds a trie of the words in `WL', reversed if `Reverse' is set.
+ * Empty words are left out. Returns FALSE if out of memory.
+ */
+
+int BuildTrie(struct Trie *t, struct WordList *WL, int Reverse)
+{
+    unsigned long i, Count, Len;
+    char **Keys, *Key, *Base, *Store;
+    int Retval;
+
+    ClearTrie(t);
+
+    Keys = malloc((WL->Stack.Used + 1) * sizeof(char *));
+    Store = Base = malloc(WL->Stack.Used * (WL->MaxLen + 1) + 1);
+    if (!Keys || !Base)
+    {
+        free(Keys);
+        free(Base);
+        return (FALSE);
+    }
+
+    /* The root is there even if there are no words */
+    Keys[0] = Store;
+    *Store++ = 0;
+    Count = 1;
+
+    FORWL(i, *WL)
+    {
+        if (!(Len = strlen(WL->Stack.Data[i])))
+            continue;
+        Key = Keys[Count++] = Store;
+        if (Reverse)
+        {
+            while (Len)
+                *Key++ = ((char *) WL->Stack.Data[i])[--Len];
+            *Key = 0;
+        }
+        else
+            strcpy(Key, WL->Stack.Data[i]);
+        Store += WL->MaxLen + 1;
+    }
+
+    qsort(Keys, Count, sizeof(char *), CmpKeys);
+
+    /* Duplicates would give a node edges with the same label */
+    for (i = 1, Len = 1; i < Count; i++)
+    {
+        if (strcmp(Keys[i], Keys[Len - 1]))
+            Keys[Len++] = Keys[i];
+    }
+
+    if ((Retval = TrieNodes(t, Keys, Len, 0, &i)))
+        t->Nodes[0].Final = FALSE;
+    else
+        ClearTrie(t);
+
+    free(Base);
+    free(Keys);
+    return (Retval);
+}
+
+/*
+ * The node reached from `Node' by `c', or 0 if there is none.
+ */
+
+unsigned long TrieStep(const struct Trie *t, unsigned long Node, char c)
+{
+    const struct TrieNode *tn = &t->Nodes[Node];
+    const char *Edge;
+
+    if (tn->Count && (Edge = memchr(&t->Labels[tn->Edges], c, tn->Count)))
+        return (t->Next[Edge - t->Labels]);
+    return (0);
+}
+
+/*
+ * Whether a word of `t' starts at `Str', or ends there if the trie
+ * is reversed; then we read backwards, so there has to be a '\0' in
+ * front of the text.
+ */
+
+int TrieMatch(const struct Trie *t, const char *Str, int Reverse)
+{
+    unsigned long Node = 0;
+
+    while ((Node = TrieStep(t, Node, *Str)))
+    {
+        if (t->Nodes[Node].Final)
+            return (TRUE);
+        Str += Reverse ? -1 : 1;
+    }
+    return (FALSE);
+}
+
+void ClearTrie(struct Trie *t)
+{
+    free(t->Nodes);
+    free(t->Labels);
+    free(t->Next);
+    memset(t, 0, sizeof(struct Trie));
+}
+
+/*
+ * A matcher (Aho-Corasick) finds all the words of a list in a text in
+ * one pass, however many words there are. It is a trie of the words,
+ * and for each node the longest proper suffix of it which is also in
+ * the trie (Fail). Feed the text to MatchStep() one byte at a time,
+ * starting at node 0; after each, the words ending there are
+ *
+ *     for (n = m->Out[Node]; n; n = m->Out[m->Fail[n]])
+ *         for (w = m->First[n]; w != NOWORD; w = m->NextWord[w])
+ *
+ * where w is the index of the word in the list.
+ */
+
+/*
+ * Builds a matcher of the words in `WL'. If `Fold' is set, the text is
+ * compared in lower case, so the words should be lower case too. Empty
+ * words are left out. Returns FALSE if out of memory.
+ */
+
+int BuildMatcher(struct Matcher *m, struct WordList *WL, int Fold)
+{
+    struct Trie *t = &m->Trie;
+    unsigned long *Queue, Head, Tail, Node, Child, f, e, i;
+    const char *Word;
+    int c;
+
+    ClearMatcher(m);
+    m->Fold = Fold;
+
+    if (!BuildTrie(t, WL, FALSE))
+        return (FALSE);
+
+    Queue = malloc(t->Used * sizeof(unsigned long));
+    m->Fail = calloc(t->Used, sizeof(unsigned long));
+    m->Out = calloc(t->Used, sizeof(unsigned long));
+    m->First = malloc(t->Used * sizeof(unsigned long));
+    m->NextWord = malloc((WL->Stack.Used + 1) * sizeof(unsigned long));
+    if (!Queue || !m->Fail || !m->Out || !m->First || !m->NextWord)
+    {
+        free(Queue);
+        ClearMatcher(m);
+        return (FALSE);
+    }
+
+    /* Parents go before their children, so their links are ready */
+    Queue[0] = 0;
+    for (Head = 0, Tail = 1; Head < Tail; Head++)
+    {
+        Node = Queue[Head];
+        for (e = 0; e < t->Nodes[Node].Count; e++)
+        {
+            c = t->Labels[t->Nodes[Node].Edges + e];
+            Child = t->Next[t->Nodes[Node].Edges + e];
+            Queue[Tail++] = Child;
+
+            if (Node)
+            {
+                for (f = m->Fail[Node]; f && !TrieStep(t, f, c);)
+                    f = m->Fail[f];
+                m->Fail[Child] = TrieStep(t, f, c);
+            }
+
+            m->Out[Child] =
+                t->Nodes[Child].Final ? Child : m->Out[m->Fail[Child]];
+        }
+    }
+    free(Queue);
+
+    for (Node = 0; Node < t->Used; Node++)
+        m->First[Node] = NOWORD;
+
+    /* Each word goes to the node where it ends */
+    FORWL(i, *WL)
+    {
+        for (Node = 0, Word = WL->Stack.Data[i];
+             *Word && (Node = TrieStep(t, Node, *Word)); Word++)
+            ;
+
+        if (Node)
+        {
+            m->NextWord[i] = m->First[Node];
+            m->First[Node] = i;
+        }
+    }
+
+    /* Most bytes take us back to, or keep us at, the root */
+    for (c = 0; c < 256; c++)
+        m->Root[c] = TrieStep(t, 0, (char) (Fold ? tolower(c) : c));
+
+    return (TRUE);
+}
+
+/*
+ * The node reached from `Node' by the next byte of the text, `c'.
+ */
+
+unsigned long MatchStep(const struct Matcher *m, unsigned long Node, char c)
+{
+    unsigned long Next;
+
+    if (m->Fold)
+        c = tolower((unsigned char)c);
+
+    while (Node)
+    {
+        if ((Next = TrieStep(&m->Trie, Node, c)))
+            return (Next);
+        Node = m->Fail[Node];
+    }
+
+    return (m->Root[(unsigned char)c]);
+}
+
+void ClearMatcher(struct Matcher *m)
+{
+    ClearTrie(&m->Trie);
+    free(m->Fail);
+    free(m->Out);
+    free(m->First);
+    free(m->NextWord);
+    memset(m, 0, sizeof(struct Matcher));
+}
+
 /************************** GENERIC STACK  ******************************/
 
 /*
@@ -680,16 +1364,21 @@ void *StkTop(struct Stack *Stack)
 
 int PushFileName(const char *Name, struct Stack *stack)
 {
-    FILE *fh = NULL;
-    static char NameBuf[BUFSIZ];
+    const char *Data;
+    unsigned long Size;
+    int Mapped;
+    char NameBuf[BUFSIZ];
 
     if (Name && stack)
     {
         if (LocateFile(Name, NameBuf, ".tex", &TeXInputs))
         {
-            if ((fh = fopen(NameBuf, "r")))
+            if ((Data = MapFile(NameBuf, &Size, &Mapped)))
             {
-                return (PushFile(NameBuf, fh, stack));
+                if (PushData(NameBuf, Data, Size, Mapped, stack))
+                    return (TRUE);
+                UnmapFile(Data, Size, Mapped);
+                return (FALSE);
             }
         }
         PrintPrgErr(pmNoTeXOpen, Name);
@@ -697,74 +1386,147 @@ int PushFileName(const char *Name, struct Stack *stack)
     return (FALSE);
 }
 
+/*
+ * Pushes a copy of the `Size' bytes at `Data' as if they were the
+ * contents of the file `Name'.
+ */
+
+int PushBuffer(const char *Name, const char *Data, unsigned long Size,
+               struct Stack *stack)
+{
+    char *Copy;
+
+    if (Name && (Data || !Size) && stack)
+    {
+        if ((Copy = malloc(Size + 1)))
+        {
+            memcpy(Copy, Data, Size);
+            Copy[Size] = 0;
+            if (PushData(Name, Copy, Size, FALSE, stack))
+                return (TRUE);
+            free(Copy);
+        }
+        else
+            PrintPrgErr(pmNoStackMem);
+    }
+
+    return (FALSE);
+}
+
+/*
+ * Pushes an already opened file; we read all of it at once, so the
+ * caller may close `fh' as soon as we return.
+ */
 
 int PushFile(const char *Name, FILE * fh, struct Stack *stack)
 {
-    struct FileNode *fn;
+    const char *Data;
+    unsigned long Size;
 
     if (Name && fh && stack)
     {
-        if ((fn = malloc(sizeof(struct FileNode))))
+        if ((Data = SlurpFile(fh, &Size)))
         {
-            if ((fn->Name = strdup(Name)))
-            {
-                fn->fh = fh;
-                fn->Line = 0L;
-                if (StkPush(fn, stack))
-                    return (TRUE);
-                free(fn->Name);
-            }
-            free(fn);
+            if (PushData(Name, Data, Size, FALSE, stack))
+                return (TRUE);
+            UnmapFile(Data, Size, FALSE);
         }
-        PrintPrgErr(pmNoStackMem);
+        else
+            PrintPrgErr(pmNoTeXOpen, Name);
     }
 
     return (FALSE);
 }
 
-char *FGetsStk(char *Dest, unsigned long len, struct Stack *stack)
+/*
+ * Pushes the `Size' bytes at `Data', as obtained from MapFile() or
+ * SlurpFile(); they're released once the file has been read.
+ */
+
+int PushData(const char *Name, const char *Data, unsigned long Size,
+             int Mapped, struct Stack *stack)
 {
-    static short HasSeenLong = 0;
     struct FileNode *fn;
-    char *Retval = NULL;
-    size_t Retlen = 0;
 
-    if ((fn = StkTop(stack)))
+    if ((fn = malloc(sizeof(struct FileNode))))
     {
-        do
+        if ((fn->Name = strdup(Name)))
         {
-            Retval = fgets(Dest, (int)len, fn->fh);
-            if (Retval) {
-                Retlen = strlen(Retval);
-
-                if (Retval[Retlen-1] == '\n' || Retlen < len-1)
-                    fn->Line++;
-                /* We only want the long lines warning once per file */
-                else if (!HasSeenLong)
-                {
-                    PrintPrgErr(pmLongLines, len-2);
-                    HasSeenLong = 1;
-                }
-                break;
-            }
+            fn->Data = Data;
+            fn->Size = Size;
+            fn->Pos = 0L;
+            fn->Mapped = Mapped;
+            fn->Line = 0L;
+            if (StkPush(fn, stack))
+                return (TRUE);
+            free(fn->Name);
+        }
+        free(fn);
+    }
+    PrintPrgErr(pmNoStackMem);
+
+    return (FALSE);
+}
 
-            fn = StkPop(stack);
-            fclose(fn->fh);
-            /* Don't free the fn->Name field because it can be referenced in an
-               error message */
-            free(fn);
-            HasSeenLong = 0;
+/*
+ * Returns the next line of the file on top of the stack, popping
+ * (and releasing) files as they are exhausted. The line is *not*
+ * copied, nor NUL terminated: it points straight into the file, and
+ * `*Len' bytes of it are valid, including the trailing newline if
+ * any. Lines may be of any length.
+ *
+ * Returns NULL when all files have been exhausted.
+ */
+
+const char *FGetsStk(struct CheckState *cs, unsigned long *Len)
+{
+    struct FileNode *fn;
+    struct Stack *stack = &cs->InputStack;
+    const char *Retval = NULL;
+    const char *Start, *NewLine;
+    unsigned long Left;
+
+    while ((fn = StkTop(stack)))
+    {
+        if (fn->Pos < fn->Size)
+        {
+            Start = &fn->Data[fn->Pos];
+            Left = fn->Size - fn->Pos;
+
+            if ((NewLine = memchr(Start, '\n', Left)))
+                Left = NewLine - Start + 1;
+
+            fn->Line++;
+            fn->Pos += Left;
+            *Len = Left;
+            Retval = Start;
+            break;
         }
-        while (!Retval && (fn = StkTop(stack)));
+
+        fn = StkPop(stack);
+        /* Reports made at the end of the document still need a name */
+        if (!stack->Used)
+            cs->LastName = fn->Name;
+        UnmapFile(fn->Data, fn->Size, fn->Mapped);
+        /* The name may still be referenced in an error message; it is
+           freed along with the document, see ResetCheckState() */
+        if (!StkPush(fn->Name, &cs->OldNames))
+            free(fn->Name);
+        free(fn);
     }
 
     return (Retval);
 }
 
-const char *CurStkName(struct Stack *stack)
+/*
+ * Name of the file currently being checked in `cs'. Once the input
+ * stack is empty, we keep returning the last one we knew of.
+ */
+
+const char *CurStkName(struct CheckState *cs)
 {
     struct FileNode *fn;
-    static const char *LastName = "";
+    struct Stack *stack = &cs->InputStack;
 
     if (PseudoInName && (stack->Used <= 1))
         return (PseudoInName);
@@ -772,86 +1534,155 @@ const char *CurStkName(struct Stack *stack)
     {
         if ((fn = StkTop(stack)))
         {
-            if ( stack->Used == 1 && strlen(LastName) == 0 && fn->Name )
+            if ( stack->Used == 1 && strlen(cs->LastName) == 0 && fn->Name )
             {
-                LastName = fn->Name;
+                cs->LastName = fn->Name;
             }
             return fn->Name;
         }
         else
-            return (LastName);
+            return (cs->LastName);
     }
 }
 
-
-FILE *CurStkFile(struct Stack * stack)
+unsigned long CurStkLine(struct CheckState *cs)
 {
     struct FileNode *fn;
 
-    if ((fn = StkTop(stack)))
-        return (fn->fh);
+    if ((fn = StkTop(&cs->InputStack)))
+        return (cs->LastLine = fn->Line);
     else
-        return (NULL);
+        return (cs->LastLine);
 }
 
-unsigned long CurStkLine(struct Stack *stack)
+
+
+/************************** CHARACTER STACK ******************************/
+
+/*
+ * The LineRef of the line being checked, for PushErr(). It is only
+ * made once, and copies nothing; see RetireLine().
+ */
+
+struct LineRef *ThisLine(struct CheckState *cs)
 {
-    struct FileNode *fn;
-    static unsigned long LastLine = 0L;
+    struct LineRef *lr = cs->CurLine;
 
-    if ((fn = StkTop(stack)))
-        return (LastLine = fn->Line);
-    else
-        return (LastLine);
+    if (!lr)
+    {
+        if (!(lr = calloc(1, sizeof(struct LineRef))))
+            PrintPrgErr(pmNoStackMem);
+        cs->CurLine = lr;
+    }
+
+    lr->Text = cs->RealBuf;
+    return (lr);
 }
 
+/*
+ * Call before RealBuf is overwritten. If anything still refers to the
+ * current line, it gets a copy of its own; if not, the LineRef is kept
+ * for the next line.
+ */
+
+void RetireLine(struct CheckState *cs)
+{
+    struct LineRef *lr = cs->CurLine;
 
+    if (lr && lr->Refs)
+    {
+        if (!(lr->Text = strdup(lr->Text ? lr->Text : "")))
+            PrintPrgErr(pmStrDupErr);
+        lr->Owned = TRUE;
+        cs->CurLine = NULL;
+    }
+}
 
-/************************** CHARACTER STACK ******************************/
+/*
+ * Lets go of `lr'; the last one to do so frees it, unless it's still
+ * the current line of a CheckState.
+ */
+
+void DropLine(struct LineRef *lr)
+{
+    if (lr && !--lr->Refs && lr->Owned)
+    {
+        free(lr->Text);
+        free(lr);
+    }
+}
 
 /*
  * Pushes the character on the stack.
  */
 
-struct ErrInfo *PushChar(const char c, const unsigned long Line,
-                         const unsigned long Column, struct Stack *Stk,
-                         const char *LineCpy)
+struct ErrInfo *PushChar(const char *File, const char c,
+                         const unsigned long Line,
+                         const unsigned long Column, struct ErrStack *Stk,
+                         struct LineRef *LineRef)
 {
     char Buf[2];
 
     Buf[0] = c;
     Buf[1] = 0;
 
-    return (PushErr(Buf, Line, Column, 1, LineCpy, Stk));
+    return (PushErr(File, Buf, Line, Column, 1, LineRef, Stk));
 }
 
-struct ErrInfo *PushErr(const char *Data, const unsigned long Line,
+/*
+ * Pushes an entry for `Data' found on line `LineRef'. Neither takes
+ * an allocation of its own, once the stack has grown big enough.
+ */
+
+struct ErrInfo *PushErr(const char *File, const char *Data,
+                        const unsigned long Line,
                         const unsigned long Column,
-                        const unsigned long ErrLen, const char *LineCpy,
-                        struct Stack *Stk)
+                        const unsigned long ErrLen, struct LineRef *LineRef,
+                        struct ErrStack *Stk)
 {
-    struct ErrInfo *ci;
+    unsigned long Len = strlen(Data) + 1, NewSize, i;
+    struct ErrInfo *ei;
+    char *NewNames;
 
-    if ((ci = malloc(sizeof(struct ErrInfo))))
+    if (Stk->Used >= Stk->Size)
     {
-        if ((ci->Data = strdup(Data)))
-        {
-            ci->File = CurStkName(&InputStack);
-            ci->Line = Line;
-            ci->ErrLen = ErrLen;
-            ci->Column = Column;
-            ci->LineBuf = strdup(LineCpy);
-            ci->Flags = efNone;
-
-            if (StkPush(ci, Stk))
-                return (ci);
-        }
-        else
-            PrintPrgErr(pmStrDupErr);
-        free(ci);
+        NewSize = Stk->Size ? Stk->Size * 2 : MINPUDDLE;
+        if (!(ei = saferealloc(Stk->Data, NewSize * sizeof(struct ErrInfo))))
+            return (NULL);
+
+        Stk->Data = ei;
+        Stk->Size = NewSize;
     }
 
-    return (NULL);
+    if (Stk->NamesUsed + Len > Stk->NamesSize)
+    {
+        NewSize = max(Stk->NamesSize * 2, Stk->NamesUsed + Len);
+        NewSize = max(NewSize, MINPUDDLE);
+        if (!(NewNames = saferealloc(Stk->Names, NewSize)))
+            return (NULL);
+
+        /* The entries have to follow their names */
+        for (i = 0; i < Stk->Used; i++)
+            Stk->Data[i].Data = NewNames + (Stk->Data[i].Data - Stk->Names);
+
+        Stk->Names = NewNames;
+        Stk->NamesSize = NewSize;
+    }
+
+    ei = &Stk->Data[Stk->Used++];
+    ei->Data = &Stk->Names[Stk->NamesUsed];
+    memcpy(ei->Data, Data, Len);
+    Stk->NamesUsed += Len;
+
+    ei->File = File;
+    ei->Line = Line;
+    ei->ErrLen = ErrLen;
+    ei->Column = Column;
+    ei->LineRef = LineRef;
+    ei->Flags = efNone;
+    LineRef->Refs++;
+
+    return (ei);
 }
 
 /*
@@ -859,62 +1690,75 @@ struct ErrInfo *PushErr(const char *Data, const unsigned long Line,
  * String.
  */
 
-struct ErrInfo *TopMatch(struct Stack *Stack, char *String)
+struct ErrInfo *TopMatch(struct ErrStack *Stack, char *String)
 {
-    int i;
-    struct ErrInfo *retval = NULL;
+    unsigned long i;
 
     if (Stack && String)
     {
-        for (i = Stack->Used - 1; i >= 0; i--)
+        for (i = Stack->Used; i-- > 0;)
         {
-            if (!strcmp(String, ((struct ErrInfo *) Stack->Data[i])->Data))
-            {
-                retval = (struct ErrInfo *) Stack->Data[i];
-                break;
-            }
+            if (!strcmp(String, Stack->Data[i].Data))
+                return (&Stack->Data[i]);
         }
     }
-    return (retval);
+    return (NULL);
 }
 
 /*
- * Returns and removes a character from the stack, returns NULL if
- * the stack is empty.
+ * Returns and removes an entry from the stack, returns NULL if the
+ * stack is empty. It stays valid up to the next push; give it to
+ * FreeErrInfo() when done.
  */
 
 
-struct ErrInfo *PopErr(struct Stack *Stack)
+struct ErrInfo *PopErr(struct ErrStack *Stack)
 {
-    return ((struct ErrInfo *) StkPop(Stack));
+    struct ErrInfo *ei;
+
+    if (!Stack->Used)
+        return (NULL);
+
+    ei = &Stack->Data[--Stack->Used];
+    Stack->NamesUsed = ei->Data - Stack->Names;
+    return (ei);
 }
 
 /*
- * Same as PopChar(), but lets the error alone on the stack.
+ * Same as PopErr(), but lets the error alone on the stack.
  */
 
 
-struct ErrInfo *TopErr(struct Stack *Stack)
+struct ErrInfo *TopErr(struct ErrStack *Stack)
 {
-    return ((struct ErrInfo *) StkTop(Stack));
+    return (Stack->Used ? &Stack->Data[Stack->Used - 1] : NULL);
 }
 
 /*
- * Free all resources associated with a struct FreeInfo.
+ * Lets go of what a popped entry refers to.
  */
 
 void FreeErrInfo(struct ErrInfo *ei)
 {
     if (ei)
     {
-        if (ei->LineBuf)
-            free((void *)ei->LineBuf);
+        DropLine(ei->LineRef);
+        ei->LineRef = NULL;
+    }
+}
 
-        if (ei->Data)
-            free(ei->Data);
+/*
+ * Empties a stack, and frees its memory.
+ */
 
-        free(ei);
-    }
+void FreeErrStack(struct ErrStack *Stack)
+{
+    while (Stack->Used)
+        FreeErrInfo(PopErr(Stack));
+
+    free(Stack->Data);
+    free(Stack->Names);
+    memset(Stack, 0, sizeof(struct ErrStack));
 }
 
 
@@ -948,10 +1792,10 @@ long BrackIndex(const char c)
 
 /*
  * Counts brackets for you. Give it a bracket, and it will update the
- * corresponding counter.
+ * corresponding counter in `Brackets'.
  */
 
-void AddBracket(const char c)
+void AddBracket(unsigned long *Brackets, const char c)
 {
     long Index;
 
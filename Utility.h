@@ -42,9 +42,7 @@
  */
 #define WALLBYTES       4
 
-#ifndef HASH_SIZE
-#  define HASH_SIZE    1009     /* A reasonably large prime */
-#endif
+#define HASH_MINSIZE    8       /* Slots in a new hash index; a power of 2 */
 
 #define FORWL(ind, list)  for(ind = 0; ind < (list).Stack.Used; ind++)
 
@@ -56,15 +54,25 @@ enum Strip
     STRP_BTH = 0x03
 };
 
-struct HashEntry
+struct HashSlot
 {
-    struct HashEntry *Next;
-    char *Str;
+    uint64_t Hash;              /* Of Str; see HashWord() */
+    unsigned long Len;          /* strlen(Str) */
+    char *Str;                  /* NULL if the slot is free */
+    void *Data;                 /* Whatever the owner wants; see AddHash() */
 };
 
+/*
+ * Open addressed, with linear probing; see InsertHash(). Those made
+ * by PerfectHash() instead have a slot for each string and no more,
+ * and displacements which tell which one it is.
+ */
 struct Hash
 {
-    struct HashEntry **Index;
+    struct HashSlot *Slots;
+    unsigned long Size, Used;   /* Size is a power of 2 */
+    const unsigned short *Disp; /* NULL unless perfect */
+    unsigned long Buckets;      /* Entries in Disp */
 };
 
 struct Stack
@@ -73,19 +81,69 @@ struct Stack
     unsigned long Size, Used;
 };
 
+/* See ArenaString() */
+struct Arena
+{
+    struct ArenaBlock *Block;   /* The one in use; the rest follow */
+};
+
+/* See BuildTrie() */
+struct TrieNode
+{
+    unsigned long Edges;        /* The first of them in Labels and Next */
+    unsigned short Count;       /* How many there are */
+    char Final;                 /* A word ends here */
+};
+
+struct Trie
+{
+    struct TrieNode *Nodes;
+    unsigned long Size, Used;
+    char *Labels;               /* The byte of each edge */
+    unsigned long *Next;        /* The node it leads to */
+    unsigned long NumEdges;
+};
+
+#define NOWORD  (~0UL)         /* Ends a chain of words in a Matcher */
+
+/* See BuildMatcher() */
+struct Matcher
+{
+    struct Trie Trie;
+    int Fold;                   /* Compare in lower case */
+    unsigned long *Fail;        /* Longest proper suffix in the trie */
+    unsigned long *Out;         /* The node, or its nearest suffix, which
+                                 * ends a word; 0 if none does */
+    unsigned long *First;       /* Index of a word ending at the node */
+    unsigned long *NextWord;    /* The next one, for each word */
+    unsigned long Root[256];    /* Where each byte takes us from the root */
+};
+
+struct Digest
+{
+    uint64_t Hi, Lo;
+};
+
+#define DIGESTLEN       32      /* Hex digits in a digest */
+
 struct WordList
 {
     unsigned long MaxLen;
     int NonEmpty;
     struct Stack Stack;
     struct Hash Hash;
+    int Mapped;                 /* Part of a compiled or built-in
+                                 * configuration; see UnshareWords() */
 };
 #define WORDLIST_DEFINED
 
 struct FileNode
 {
     char *Name;
-    FILE *fh;
+    const char *Data;           /* The whole file, see MapFile() */
+    unsigned long Size;         /* Bytes in Data */
+    unsigned long Pos;          /* Offset of the next line in Data */
+    int Mapped;
     unsigned long Line;
 };
 
@@ -103,7 +161,7 @@ struct FileNode
 
 int fexists(const char *Filename);
 
-void *sfmemset(void *to, int c, long n);
+void GrowBuf(char **Buf, unsigned long *Size, unsigned long Len);
 void *saferealloc(void *old, size_t newsize);
 
 int strafter(const char *Str, const char *Cmp);
@@ -115,49 +173,81 @@ int strinfront(const char *Str, const char *Cmp);
 char *strdupx(const char *String, int Extra);
 void strmove(char *a, const char *b);
 
+void InitDigest(struct Digest *d);
+void AddDigest(struct Digest *d, const void *Data, unsigned long Len);
+void AddDigestStr(struct Digest *d, const char *Str);
+void DigestHex(const struct Digest *d, char *Buf);
+
+uint64_t HashData(const char *Data, unsigned long Len);
+int PerfectHash(const struct Hash *In, struct Hash *Out);
 void ClearHash(struct Hash *h);
 void InsertHash(char *a, struct Hash *h);
+struct HashSlot *AddHash(char *a, struct Hash *h);
+struct HashSlot *FindHash(const char *a, const struct Hash *h);
 char *HasHash(const char *a, const struct Hash *h);
 
+char *ArenaString(struct Arena *a, const char *Str, unsigned long Len,
+                  unsigned long Extra);
+void FreeArena(struct Arena *a);
+
+int BuildTrie(struct Trie *t, struct WordList *WL, int Reverse);
+unsigned long TrieStep(const struct Trie *t, unsigned long Node, char c);
+int TrieMatch(const struct Trie *t, const char *Str, int Reverse);
+void ClearTrie(struct Trie *t);
+int BuildMatcher(struct Matcher *m, struct WordList *WL, int Fold);
+unsigned long MatchStep(const struct Matcher *m, unsigned long Node, char c);
+void ClearMatcher(struct Matcher *m);
+
 int InsertWord(const char *Word, struct WordList *WL);
 char *HasWord(const char *Word, struct WordList *WL);
 void MakeLower(struct WordList *wl);
 void ListRep(struct WordList *wl, const char From, const char To);
 void ClearWord(struct WordList *WL);
+void ShareWords(struct WordList *WL, const char *const *Words,
+                unsigned long NumWords, unsigned long MaxLen,
+                const struct Hash *Hash);
+void UnshareWords(struct WordList *WL);
 
 int StkPush(void *Data, struct Stack *Stack);
 void *StkPop(struct Stack *Stack);
 void *StkTop(struct Stack *Stack);
 
-FILE *CurStkFile(struct Stack *stack);
-const char *CurStkName(struct Stack *stack);
-unsigned long CurStkLine(struct Stack *stack);
-char *FGetsStk(char *Dest, unsigned long len, struct Stack *stack);
+const char *CurStkName(struct CheckState *cs);
+unsigned long CurStkLine(struct CheckState *cs);
+const char *FGetsStk(struct CheckState *cs, unsigned long *Len);
 int PushFileName(const char *Name, struct Stack *stack);
 int PushFile(const char *, FILE *, struct Stack *);
+int PushBuffer(const char *Name, const char *Data, unsigned long Size,
+               struct Stack *stack);
+int PushData(const char *Name, const char *Data, unsigned long Size,
+             int Mapped, struct Stack *stack);
+
 
+struct LineRef *ThisLine(struct CheckState *cs);
+void RetireLine(struct CheckState *cs);
+void DropLine(struct LineRef *lr);
 
 void FreeErrInfo(struct ErrInfo *ei);
-struct ErrInfo *PushChar(const char c, const unsigned long Line,
-                         const unsigned long Column, struct Stack *Stk,
-                         const char *LineCpy);
-struct ErrInfo *PushErr(const char *Data, const unsigned long Line,
+struct ErrInfo *PushChar(const char *File, const char c,
+                         const unsigned long Line,
+                         const unsigned long Column, struct ErrStack *Stk,
+                         struct LineRef *LineRef);
+struct ErrInfo *PushErr(const char *File, const char *Data,
+                        const unsigned long Line,
                         const unsigned long Column,
-                        const unsigned long ErrLen, const char *LineCpy,
-                        struct Stack *Stk);
-struct ErrInfo *TopChar(struct Stack *Stack);
-struct ErrInfo *TopErr(struct Stack *Stack);
-struct ErrInfo *PopErr(struct Stack *Stack);
-struct ErrInfo *TopMatch(struct Stack *Stack, char *String);
+                        const unsigned long ErrLen, struct LineRef *LineRef,
+                        struct ErrStack *Stk);
+struct ErrInfo *TopErr(struct ErrStack *Stack);
+struct ErrInfo *PopErr(struct ErrStack *Stack);
+struct ErrInfo *TopMatch(struct ErrStack *Stack, char *String);
+void FreeErrStack(struct ErrStack *Stack);
 
 long BrackIndex(const char c);
-void AddBracket(const char c);
+void AddBracket(unsigned long *Brackets, const char c);
 char MatchBracket(const char c);
 
 
 
-short substring(const char *source, char *dest, unsigned long pos, long len);
-
 #ifndef  HAVE_STRLWR
 #  define  strlwr  mystrlwr
 char *mystrlwr(char *String);